@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Builds and runs the microbenchmarks in bench/. Uses the same LLVM lookup as
+# build.sh since the benchmarks compile main.c directly.
+#
+# `./bench.sh throughput [options]` instead builds doc_gen and times it end to
+# end on a generated corpus; see `bench/throughput --help`.
+HOMEBREW_LLVM_PATH="/opt/homebrew/opt/llvm/bin"
+
+if [ -f "$HOMEBREW_LLVM_PATH/llvm-config" ] && [ -f "$HOMEBREW_LLVM_PATH/clang" ]; then
+    CLANG="$HOMEBREW_LLVM_PATH/clang"
+    LLVM_CONFIG="$HOMEBREW_LLVM_PATH/llvm-config"
+else
+    CLANG="clang"
+    LLVM_CONFIG="llvm-config"
+fi
+
+if [ "$1" = "throughput" ]; then
+    shift
+    ./build.sh > /dev/null || exit 1
+    $CLANG -std=c11 -O2 -o bench/throughput bench/throughput.c
+    if [ $? -ne 0 ]; then
+        echo "Build failed!"
+        exit 1
+    fi
+    ./bench/throughput "$@"
+    exit $?
+fi
+
+$CLANG -std=c11 -O3 -march=native -pthread -DDOC_GEN_ALLOC_COUNT -o bench/micro bench/micro.c -I$($LLVM_CONFIG --includedir) -L$($LLVM_CONFIG --libdir) -lclang
+
+if [ $? -ne 0 ]; then
+    echo "Build failed!"
+    exit 1
+fi
+
+./bench/micro "$@"
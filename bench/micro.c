@@ -0,0 +1,574 @@
+/**
+ * Microbenchmarks for doc_gen's internal kernels.
+ *
+ * The generator is a single translation unit, so the benchmarks include it
+ * directly and call its static helpers. Build and run through `../bench.sh`.
+ */
+
+#define main doc_gen_main
+#include "../main.c"
+#undef main
+
+#include <time.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void add_symbol(EntryVec *vec, const char *prefix, size_t i) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s_%zu", prefix, i);
+    if (vec->n == vec->cap) {
+        vec->cap = vec->cap ? vec->cap * 2 : 64;
+        vec->data = (Entry*)realloc(vec->data, vec->cap * sizeof(Entry));
+        if (!vec->data) die("out of memory");
+    }
+    Entry *e = &vec->data[vec->n++];
+    e->name = strdup(name);
+    e->anchor = strdup(make_anchor(prefix, name));
+    e->kind = NULL;
+    e->file = 0;
+    e->usr = NULL;
+    e->decl = NULL;
+    e->path = NULL;
+    e->line = 0;
+}
+
+/* A docstring where roughly one word in four names a known symbol. */
+static char *make_link_text(size_t nsyms, size_t words) {
+    StrBuf sb = {0};
+    for (size_t i = 0; i < words; ++i) {
+        size_t pick = (i * 2654435761u) % nsyms;
+        switch (i % 4) {
+            case 0: sb_appendf(&sb, "api_fn_%zu", pick); break;
+            case 1: sb_append(&sb, "returns"); break;
+            case 2: sb_append(&sb, "the_value"); break;
+            default: sb_append(&sb, "when"); break;
+        }
+        sb_append_char(&sb, (i % 12 == 11) ? '\n' : ' ');
+    }
+    return sb_detach(&sb);
+}
+
+static void bench_link(void) {
+    static const size_t sizes[] = { 100, 1000, 10000, 100000 };
+    const size_t words = 200000;
+    printf("link_docstring_segment (%zu words per run)\n", words);
+    printf("  %10s  %12s  %10s\n", "symbols", "ns/word", "ms/run");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        size_t nsyms = sizes[s];
+        for (size_t i = 0; i < nsyms; ++i) {
+            add_symbol(&g_functions, "api_fn", i);
+            add_symbol(&g_types, "api_type", i);
+            add_symbol(&g_macros, "API_MACRO", i);
+        }
+        symindex_build(&g_symbol_index);
+        char *text = make_link_text(nsyms, words);
+        size_t text_len = strlen(text);
+        StrBuf linked = {0};
+        uint64_t best = UINT64_MAX;
+        for (int rep = 0; rep < 5; ++rep) {
+            linked.len = 0;
+            uint64_t t0 = now_ns();
+            link_docstring_segment(&linked, text, text_len);
+            uint64_t dt = now_ns() - t0;
+            if (dt < best) best = dt;
+        }
+        sb_free(&linked);
+        printf("  %10zu  %12.1f  %10.2f\n", nsyms * 3, (double)best / (double)words, (double)best / 1e6);
+        free(text);
+        symindex_free(&g_symbol_index);
+        entryvec_free(&g_functions);
+        entryvec_free(&g_types);
+        entryvec_free(&g_macros);
+    }
+}
+
+/* The recursive backtracking matcher --ignore used to run, kept as a
+ * reference for both correctness and timing. */
+static bool backtrack_match(const char *pat, const char *text) {
+    if (*pat == '\0') return *text == '\0';
+    if (*pat == '*') {
+        while (*pat == '*') pat++;
+        if (*pat == '\0') return true;
+        for (; *text; ++text) {
+            if (backtrack_match(pat, text)) return true;
+        }
+        return backtrack_match(pat, text);
+    }
+    if (*text == '\0') return false;
+    if (*pat == '?' || *pat == *text) return backtrack_match(pat + 1, text + 1);
+    return false;
+}
+
+static bool backtrack_any(const StrSet *patterns, const char *name) {
+    for (size_t i = 0; i < patterns->n; ++i) {
+        if (backtrack_match(patterns->data[i], name)) return true;
+    }
+    return false;
+}
+
+static void glob_check(const StrSet *patterns, const GlobSet *g, const char *name) {
+    if (globset_match(g, name) != backtrack_any(patterns, name)) {
+        fprintf(stderr, "globset mismatch on \"%s\"\n", name);
+        exit(1);
+    }
+}
+
+/* Random patterns over a tiny alphabet hit every prefilter and NFA path. */
+static void glob_fuzz(void) {
+    static const char alphabet[] = "ab_*?";
+    uint32_t seed = 12345;
+    for (int round = 0; round < 2000; ++round) {
+        StrSet patterns = {0};
+        int npat = 1 + (int)(seed % 5);
+        for (int i = 0; i < npat; ++i) {
+            char pat[12];
+            seed = seed * 1103515245u + 12345u;
+            int len = (int)((seed >> 16) % 10);
+            for (int k = 0; k < len; ++k) {
+                seed = seed * 1103515245u + 12345u;
+                pat[k] = alphabet[(seed >> 16) % 5];
+            }
+            pat[len] = '\0';
+            set_add(&patterns, pat);
+        }
+        GlobSet g;
+        globset_compile(&g, &patterns);
+        for (int n = 0; n < 50; ++n) {
+            char name[16];
+            seed = seed * 1103515245u + 12345u;
+            int len = 1 + (int)((seed >> 16) % 14);
+            for (int k = 0; k < len; ++k) {
+                seed = seed * 1103515245u + 12345u;
+                name[k] = alphabet[(seed >> 16) % 3];
+            }
+            name[len] = '\0';
+            glob_check(&patterns, &g, name);
+        }
+        globset_free(&g);
+        set_free(&patterns);
+    }
+}
+
+static void bench_glob(void) {
+    glob_fuzz();
+
+    // Adversarial: every '*' can split a long run of '_' many ways and the
+    // 'x' near the end never matches, so backtracking explores them all. The
+    // trailing '?' defeats the literal suffix check and forces the NFA.
+    static const char *adversarial[] = { "*_*_*_*x?", "*a*a*a*a*b?", "??*??*??*z?" };
+    // A realistic vendor/compiler-internal filter list.
+    static const char *vendor[] = {
+        "__*", "_GLIBCXX_*", "_LIBCPP_*", "*_INTERNAL", "*_impl", "vendor_*", "VND_*_RESERVED?",
+        "*_t", "pthread_*", "*_deprecated_*", "SDK_PRIVATE_*", "__builtin_*", "*_v[0-9]",
+    };
+    StrSet patterns = {0};
+    for (size_t i = 0; i < sizeof(vendor) / sizeof(vendor[0]); ++i) set_add(&patterns, vendor[i]);
+    // Pad out to roughly 40 patterns like a real --ignore list.
+    for (int i = 0; patterns.n < 40; ++i) {
+        char pat[32];
+        snprintf(pat, sizeof(pat), "thirdparty%d_*", i);
+        set_add(&patterns, pat);
+    }
+
+    printf("\nglobset_match vs backtracking (%zu vendor patterns)\n", patterns.n);
+    printf("  %-28s  %12s  %14s\n", "case", "globset ns", "backtrack ns");
+
+    GlobSet g;
+    globset_compile(&g, &patterns);
+    static const char *names[] = { "sample_run", "__GCC_HAVE_DWARF2_CFI_ASM", "my_private_impl", "ApiHandle" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        glob_check(&patterns, &g, names[i]);
+        const int reps = 200000;
+        uint64_t t0 = now_ns();
+        int hits = 0;
+        for (int r = 0; r < reps; ++r) hits += globset_match(&g, names[i]);
+        uint64_t t1 = now_ns();
+        for (int r = 0; r < reps; ++r) hits += backtrack_any(&patterns, names[i]);
+        uint64_t t2 = now_ns();
+        printf("  %-28s  %12.1f  %14.1f\n", names[i], (double)(t1 - t0) / reps, (double)(t2 - t1) / reps);
+        if (hits < 0) printf("unreachable\n");
+    }
+    globset_free(&g);
+    set_free(&patterns);
+
+    for (size_t i = 0; i < sizeof(adversarial) / sizeof(adversarial[0]); ++i) {
+        StrSet one = {0};
+        set_add(&one, adversarial[i]);
+        globset_compile(&g, &one);
+        for (size_t len = 16; len <= 64; len *= 2) {
+            char name[128];
+            for (size_t k = 0; k < len; ++k) name[k] = (k % 2) ? '_' : 'a';
+            name[len] = '\0';
+            glob_check(&one, &g, name);
+            char label[64];
+            snprintf(label, sizeof(label), "%s len=%zu", adversarial[i], len);
+            const int reps = 2000;
+            uint64_t t0 = now_ns();
+            int hits = 0;
+            for (int r = 0; r < reps; ++r) hits += globset_match(&g, name);
+            uint64_t t1 = now_ns();
+            // Backtracking gets too slow to repeat past a couple dozen bytes.
+            int brep = len <= 16 ? reps : 1;
+            for (int r = 0; r < brep; ++r) hits += backtrack_any(&one, name);
+            uint64_t t2 = now_ns();
+            printf("  %-28s  %12.1f  %14.1f\n", label, (double)(t1 - t0) / reps, (double)(t2 - t1) / brep);
+            if (hits < 0) printf("unreachable\n");
+        }
+        globset_free(&g);
+        set_free(&one);
+    }
+}
+
+/* A field-style one-liner and a full function comment, the two shapes that
+ * dominate heavily documented headers. */
+static void bench_normalize(void) {
+    static const char *const comments[] = {
+        "/** Number of bytes currently buffered. */",
+        "/**\n"
+        " * Copy up to `len` bytes from the ring into `dst`.\n"
+        " *\n"
+        " * Blocks until at least one byte is available unless the ring was\n"
+        " * opened non-blocking.\n"
+        " *\n"
+        " * @param ring the ring buffer\n"
+        " * @param dst destination, at least `len` bytes\n"
+        " * @param len maximum number of bytes to copy\n"
+        " * @return number of bytes copied, or -1 on error\n"
+        " * @note Thread-safe for a single reader.\n"
+        " */",
+    };
+    printf("\nnormalize_comment\n");
+    printf("  %-12s  %12s  %10s\n", "comment", "ns/comment", "ns/byte");
+    for (size_t i = 0; i < sizeof(comments) / sizeof(comments[0]); ++i) {
+        const int reps = 100000;
+        size_t len = strlen(comments[i]);
+        uint64_t t0 = now_ns();
+        for (int r = 0; r < reps; ++r) {
+            free(normalize_comment(comments[i]));
+            arena_reset(&t_arena);
+        }
+        uint64_t dt = now_ns() - t0;
+        printf("  %-12s  %12.1f  %10.2f\n", i == 0 ? "one-line" : "doxygen",
+               (double)dt / reps, (double)dt / reps / (double)len);
+    }
+}
+
+/* The kernel suite: each hot string function on a representative input and
+ * an adversarial one, reported as ns/byte of input and heap allocations per
+ * call. Results can be saved as a baseline and later runs compared against
+ * it, failing when a kernel got slower than the threshold allows or
+ * allocates more than it used to. */
+
+typedef struct {
+    const char *name;
+    char *(*make_input)(void);
+    void (*run)(const char *input, size_t len);
+} KernelCase;
+
+typedef struct {
+    char name[64];
+    double ns_per_byte, allocs_per_call;
+} KernelResult;
+
+#ifdef DOC_GEN_ALLOC_COUNT
+static size_t alloc_count(void) { return atomic_load(&g_alloc_count); }
+#else
+static size_t alloc_count(void) { return 0; }
+#endif
+
+static StrBuf g_link_out;
+static GlobSet g_vendor_globs, g_adversarial_globs;
+static volatile size_t g_sink;
+
+static void run_normalize(const char *in, size_t len) {
+    (void)len;
+    free(normalize_comment(in));
+    arena_reset(&t_arena);
+}
+
+static void run_doxygen(const char *in, size_t len) { free(doxygen_to_markdown(in, len)); }
+
+static void run_bump(const char *in, size_t len) {
+    (void)len;
+    free(bump_markdown_headers(in));
+}
+
+// The output buffer is reused across calls, as the writer reuses its scratch.
+static void run_link(const char *in, size_t len) {
+    g_link_out.len = 0;
+    link_docstring_segment(&g_link_out, in, len);
+}
+
+static void run_anchor(const char *in, size_t len) {
+    (void)len;
+    g_sink += (size_t)make_anchor("function", in)[0];
+    arena_reset(&t_arena);
+}
+
+static void run_glob_vendor(const char *in, size_t len) {
+    (void)len;
+    g_sink += globset_match(&g_vendor_globs, in);
+}
+
+static void run_glob_adversarial(const char *in, size_t len) {
+    (void)len;
+    g_sink += globset_match(&g_adversarial_globs, in);
+}
+
+static char *repeat(const char *unit, size_t times) {
+    StrBuf sb = {0};
+    for (size_t i = 0; i < times; ++i) sb_append(&sb, unit);
+    return sb_detach(&sb);
+}
+
+static char *in_comment_line(void) { return strdup("/** Number of bytes currently buffered. */"); }
+
+static char *in_comment_doxygen(void) {
+    return strdup("/**\n"
+                  " * Copy up to `len` bytes from the ring into `dst`.\n"
+                  " *\n"
+                  " * Blocks until at least one byte is available unless the ring was\n"
+                  " * opened non-blocking.\n"
+                  " *\n"
+                  " * @param ring the ring buffer\n"
+                  " * @param dst destination, at least `len` bytes\n"
+                  " * @param len maximum number of bytes to copy\n"
+                  " * @return number of bytes copied, or -1 on error\n"
+                  " * @note Thread-safe for a single reader.\n"
+                  " */");
+}
+
+// Thousands of tags, each opening a new block.
+static char *in_comment_tags(void) {
+    StrBuf sb = {0};
+    sb_append(&sb, "/**\n");
+    for (int i = 0; i < 2000; ++i) sb_appendf(&sb, " * @param p%d value %d, see api_fn_%d\n", i, i, i);
+    sb_append(&sb, " */");
+    return sb_detach(&sb);
+}
+
+static char *in_dox_typical(void) {
+    return strdup("Copy up to `len` bytes from the ring into `dst`.\n\n"
+                  "Blocks until at least one byte is available.\n\n"
+                  "@param ring the ring buffer\n"
+                  "@param dst destination, at least `len` bytes\n"
+                  "@return number of bytes copied, or -1 on error\n"
+                  "@code\n"
+                  "ssize_t n = ring_read(r, buf, sizeof(buf));\n"
+                  "@endcode\n");
+}
+
+// Alternating tags and code blocks overflow the on-stack block table.
+static char *in_dox_blocks(void) {
+    return repeat("@param a value\n@note careful\n@code\nx = 1;\n@endcode\n", 1000);
+}
+
+static char *in_bump_typical(void) {
+    return repeat("# Title\n\nSome text.\n\n## Section\n\n```\n# not a header\n```\n", 20);
+}
+
+static char *in_bump_headers(void) { return repeat("###### deep\n", 10000); }
+
+static char *in_link_prose(void) { return make_link_text(1000, 2000); }
+
+// One 64 KiB identifier: every byte is scanned, nothing resolves.
+static char *in_link_word(void) { return repeat("a_", 32768); }
+
+static char *in_anchor_typical(void) { return strdup("ring_buffer_read"); }
+
+static char *in_anchor_punct(void) { return repeat("operator<<(::ns::T&, *)", 200); }
+
+static char *in_glob_typical(void) { return strdup("__GCC_HAVE_DWARF2_CFI_ASM"); }
+
+static char *in_glob_adversarial(void) { return repeat("a_", 32); }
+
+static const KernelCase kernel_cases[] = {
+    { "normalize_comment/one-line", in_comment_line, run_normalize },
+    { "normalize_comment/doxygen", in_comment_doxygen, run_normalize },
+    { "normalize_comment/2k-tags", in_comment_tags, run_normalize },
+    { "doxygen_to_markdown/typical", in_dox_typical, run_doxygen },
+    { "doxygen_to_markdown/4k-blocks", in_dox_blocks, run_doxygen },
+    { "bump_markdown_headers/typical", in_bump_typical, run_bump },
+    { "bump_markdown_headers/10k-hdrs", in_bump_headers, run_bump },
+    { "link_docstring_segment/prose", in_link_prose, run_link },
+    { "link_docstring_segment/64k-word", in_link_word, run_link },
+    { "make_anchor/typical", in_anchor_typical, run_anchor },
+    { "make_anchor/punctuation", in_anchor_punct, run_anchor },
+    { "globset_match/vendor", in_glob_typical, run_glob_vendor },
+    { "globset_match/adversarial", in_glob_adversarial, run_glob_adversarial },
+};
+#define NKERNELS (sizeof(kernel_cases) / sizeof(kernel_cases[0]))
+
+/* Grow the batch until it takes at least 10 ms, then keep the best of five
+ * batches. Allocations are deterministic, so one batch is enough for them. */
+static void measure_kernel(const KernelCase *kc, KernelResult *out, size_t *bytes, double *ns_per_call) {
+    char *in = kc->make_input();
+    size_t len = strlen(in);
+    size_t reps = 1;
+    for (;;) {
+        uint64_t t0 = now_ns();
+        for (size_t r = 0; r < reps; ++r) kc->run(in, len);
+        if (now_ns() - t0 >= 10000000 || reps >= ((size_t)1 << 24)) break;
+        reps *= 2;
+    }
+    uint64_t best = UINT64_MAX;
+    size_t allocs = 0;
+    for (int batch = 0; batch < 5; ++batch) {
+        size_t a0 = alloc_count();
+        uint64_t t0 = now_ns();
+        for (size_t r = 0; r < reps; ++r) kc->run(in, len);
+        uint64_t dt = now_ns() - t0;
+        allocs = alloc_count() - a0;
+        if (dt < best) best = dt;
+    }
+    free(in);
+    snprintf(out->name, sizeof(out->name), "%s", kc->name);
+    *bytes = len;
+    *ns_per_call = (double)best / (double)reps;
+    out->ns_per_byte = *ns_per_call / (double)(len ? len : 1);
+    out->allocs_per_call = (double)allocs / (double)reps;
+}
+
+/* Baseline files hold one "name ns_per_byte allocs_per_call" line per kernel;
+ * lines starting with '#' are comments. */
+static size_t load_baseline(const char *path, KernelResult *base, size_t cap) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "error: cannot read baseline %s\n", path);
+        exit(2);
+    }
+    size_t n = 0;
+    char line[256];
+    while (n < cap && fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (sscanf(line, "%63s %lf %lf", base[n].name, &base[n].ns_per_byte, &base[n].allocs_per_call) == 3) n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+static const KernelResult *find_baseline(const KernelResult *base, size_t n, const char *name) {
+    for (size_t i = 0; i < n; ++i) {
+        if (strcmp(base[i].name, name) == 0) return &base[i];
+    }
+    return NULL;
+}
+
+/* Returns the number of kernels that regressed against the baseline. */
+static int bench_kernels(const char *baseline, const char *save, double threshold) {
+    for (size_t i = 0; i < 1000; ++i) {
+        add_symbol(&g_functions, "api_fn", i);
+        add_symbol(&g_types, "api_type", i);
+        add_symbol(&g_macros, "API_MACRO", i);
+    }
+    symindex_build(&g_symbol_index);
+    static const char *vendor[] = {
+        "__*", "_GLIBCXX_*", "_LIBCPP_*", "*_INTERNAL", "*_impl", "vendor_*", "VND_*_RESERVED?",
+        "*_t", "pthread_*", "*_deprecated_*", "SDK_PRIVATE_*", "__builtin_*", "*_v[0-9]",
+    };
+    // Kept alive until the sets are freed at the end.
+    StrSet vendor_patterns = {0}, adversarial_patterns = {0};
+    for (size_t i = 0; i < sizeof(vendor) / sizeof(vendor[0]); ++i) set_add(&vendor_patterns, vendor[i]);
+    globset_compile(&g_vendor_globs, &vendor_patterns);
+    set_add(&adversarial_patterns, "*_*_*_*x?");
+    globset_compile(&g_adversarial_globs, &adversarial_patterns);
+
+    KernelResult base[NKERNELS * 2];
+    size_t nbase = baseline ? load_baseline(baseline, base, NKERNELS * 2) : 0;
+    KernelResult results[NKERNELS];
+    int regressions = 0;
+
+    printf("\nkernels%s\n", baseline ? "" : " (no baseline)");
+    printf("  %-34s  %8s  %10s  %9s  %11s  %8s\n", "kernel/case", "bytes", "ns/call", "ns/byte", "allocs/call",
+           baseline ? "vs base" : "");
+    for (size_t k = 0; k < NKERNELS; ++k) {
+        size_t bytes;
+        double ns_per_call;
+        KernelResult *r = &results[k];
+        measure_kernel(&kernel_cases[k], r, &bytes, &ns_per_call);
+        printf("  %-34s  %8zu  %10.1f  %9.3f  %11.2f", r->name, bytes, ns_per_call, r->ns_per_byte,
+               r->allocs_per_call);
+        const KernelResult *b = baseline ? find_baseline(base, nbase, r->name) : NULL;
+        if (b) {
+            double delta = b->ns_per_byte > 0 ? (r->ns_per_byte / b->ns_per_byte - 1.0) * 100.0 : 0.0;
+            bool slower = delta > threshold;
+            bool more_allocs = r->allocs_per_call > b->allocs_per_call + 0.005;
+            printf("  %+7.1f%%%s%s", delta, slower ? "  SLOWER" : "", more_allocs ? "  MORE ALLOCS" : "");
+            if (slower || more_allocs) regressions++;
+        } else if (baseline) {
+            printf("  %8s", "new");
+        }
+        printf("\n");
+    }
+
+    if (save) {
+        FILE *fp = fopen(save, "w");
+        if (!fp) {
+            fprintf(stderr, "error: cannot write %s\n", save);
+            exit(2);
+        }
+        fprintf(fp, "# kernel ns_per_byte allocs_per_call\n");
+        for (size_t k = 0; k < NKERNELS; ++k) {
+            fprintf(fp, "%s %.4f %.2f\n", results[k].name, results[k].ns_per_byte, results[k].allocs_per_call);
+        }
+        fclose(fp);
+    }
+    if (baseline) {
+        if (regressions) printf("%d kernel(s) regressed beyond %.0f%%\n", regressions, threshold);
+        else printf("no regressions beyond %.0f%%\n", threshold);
+    }
+
+    globset_free(&g_vendor_globs);
+    globset_free(&g_adversarial_globs);
+    set_free(&vendor_patterns);
+    set_free(&adversarial_patterns);
+    sb_free(&g_link_out);
+    symindex_free(&g_symbol_index);
+    entryvec_free(&g_functions);
+    entryvec_free(&g_types);
+    entryvec_free(&g_macros);
+    return regressions;
+}
+
+static void print_micro_help(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("Time doc_gen's string kernels.\n\n");
+    printf("Options:\n");
+    printf("  --kernels-only      Skip the scaling tables and run only the kernel suite\n");
+    printf("  --save FILE         Write the kernel results to FILE for use as a baseline\n");
+    printf("  --baseline FILE     Compare against FILE; exit 1 on a regression\n");
+    printf("  --threshold PCT     Allowed ns/byte slowdown against the baseline (default 10)\n");
+}
+
+int main(int argc, char **argv) {
+    const char *baseline = NULL, *save = NULL;
+    double threshold = 10.0;
+    bool kernels_only = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_micro_help(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "--kernels-only") == 0) {
+            kernels_only = true;
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "error: unknown option or missing value: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!kernels_only) {
+        bench_link();
+        bench_glob();
+        bench_normalize();
+    }
+    return bench_kernels(baseline, save, threshold) ? 1 : 0;
+}
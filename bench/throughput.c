@@ -0,0 +1,285 @@
+/**
+ * End-to-end throughput benchmark for doc_gen.
+ *
+ * Generates a synthetic corpus of documented C headers, runs the doc_gen
+ * binary over it a few times and reports files/s, symbols/s, output MB/s
+ * and peak RSS as JSON. Build and run through `../bench.sh throughput`.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+    int files, functions, macros, typedefs, structs, enums;
+    int doc_lines;  // prose lines in each function comment
+    int code_every; // every Nth function gets an @code block (0 = none)
+    int jobs, runs;
+    const char *dir, *doc_gen, *out;
+    int extra_argc; // doc_gen options passed after `--`
+    char **extra_argv;
+} Config;
+
+static void die(const char *msg) {
+    fprintf(stderr, "error: %s\n", msg);
+    exit(1);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static const char *const words[] = {
+    "the", "handle", "is", "released", "when", "count", "reaches", "zero",
+    "and", "callers", "must", "hold", "lock", "before", "reading", "state",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+/* One line of filler prose that mentions a symbol from the next file, so
+ * auto-linking has both hits and misses to resolve. */
+static void prose_line(FILE *fp, int file, int next, int sym, int line) {
+    fprintf(fp, " *");
+    for (int w = 0; w < 10; ++w) {
+        if (w == 5) fprintf(fp, " f%d_fn_%d", next, (sym + line) % 97);
+        else fprintf(fp, " %s", words[(size_t)(sym * 7 + line * 3 + w + file) % NWORDS]);
+    }
+    fprintf(fp, ".\n");
+}
+
+static size_t write_header(const Config *cfg, int file, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) die("cannot write corpus file");
+    int next = (file + 1) % cfg->files;
+    fprintf(fp, "/**\n * @file\n * Synthetic header %d generated by bench/throughput.\n */\n\n", file);
+    fprintf(fp, "#ifndef BENCH_F%d_H\n#define BENCH_F%d_H\n\n", file, file);
+    for (int i = 0; i < cfg->macros; ++i) {
+        fprintf(fp, "/** Scales @p x by %d; see f%d_rec_%d. */\n", i, file, i % (cfg->structs ? cfg->structs : 1));
+        fprintf(fp, "#define F%d_MACRO_%d(x) ((x) * %d)\n\n", file, i, i + 1);
+    }
+    for (int i = 0; i < cfg->typedefs; ++i) {
+        fprintf(fp, "/** Opaque handle number %d. */\ntypedef unsigned long f%d_handle_%d;\n\n", i, file, i);
+    }
+    for (int i = 0; i < cfg->enums; ++i) {
+        fprintf(fp, "/** Modes for group %d. */\nenum f%d_mode_%d {\n", i, file, i);
+        fprintf(fp, "    F%d_MODE_%d_OFF, /**< Disabled. */\n    F%d_MODE_%d_ON   /**< Enabled. */\n};\n\n",
+                file, i, file, i);
+    }
+    for (int i = 0; i < cfg->structs; ++i) {
+        fprintf(fp, "/**\n * @brief Record %d.\n *\n", i);
+        prose_line(fp, file, next, i, 0);
+        fprintf(fp, " */\nstruct f%d_rec_%d {\n    int id;      /**< Identifier. */\n"
+                    "    long value;  /**< Current value. */\n};\n\n", file, i);
+    }
+    for (int i = 0; i < cfg->functions; ++i) {
+        fprintf(fp, "/**\n * @brief Operation %d on a record.\n *\n", i);
+        for (int l = 0; l < cfg->doc_lines; ++l) prose_line(fp, file, next, i, l);
+        fprintf(fp, " *\n * @param rec The record to update.\n * @param n Number of items.\n");
+        fprintf(fp, " * @return Zero on success.\n");
+        if (cfg->code_every > 0 && i % cfg->code_every == 0) {
+            fprintf(fp, " *\n * @code\n * struct f%d_rec_0 r = {0};\n * f%d_fn_%d(&r, 1);\n * @endcode\n",
+                    file, file, i);
+        }
+        int rec = cfg->structs ? i % cfg->structs : -1;
+        if (rec >= 0) fprintf(fp, " */\nint f%d_fn_%d(struct f%d_rec_%d *rec, unsigned long n);\n\n", file, i, file, rec);
+        else fprintf(fp, " */\nint f%d_fn_%d(void *rec, unsigned long n);\n\n", file, i);
+    }
+    fprintf(fp, "#endif\n");
+    long size = ftell(fp);
+    fclose(fp);
+    return size > 0 ? (size_t)size : 0;
+}
+
+typedef struct {
+    double wall_s;
+    long peak_rss_kb;
+    size_t output_bytes;
+} RunResult;
+
+static RunResult run_doc_gen(const Config *cfg, char **paths, const char *out_path) {
+    char jobs[16];
+    snprintf(jobs, sizeof(jobs), "%d", cfg->jobs);
+    int argc = 0;
+    char **argv = (char**)calloc((size_t)(cfg->files + cfg->extra_argc + 4), sizeof(char*));
+    if (!argv) die("out of memory");
+    argv[argc++] = (char*)cfg->doc_gen;
+    argv[argc++] = "-j";
+    argv[argc++] = jobs;
+    for (int i = 0; i < cfg->extra_argc; ++i) argv[argc++] = cfg->extra_argv[i];
+    for (int i = 0; i < cfg->files; ++i) argv[argc++] = paths[i];
+    argv[argc] = NULL;
+
+    uint64_t start = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) die("fork failed");
+    if (pid == 0) {
+        int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) _exit(127);
+        close(fd);
+        execv(cfg->doc_gen, argv);
+        fprintf(stderr, "error: cannot run %s: %s\n", cfg->doc_gen, strerror(errno));
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    if (wait4(pid, &status, 0, &ru) < 0) die("wait failed");
+    RunResult r;
+    r.wall_s = (double)(now_ns() - start) / 1e9;
+    free(argv);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) die("doc_gen failed");
+#ifdef __APPLE__
+    r.peak_rss_kb = ru.ru_maxrss / 1024; // bytes on macOS
+#else
+    r.peak_rss_kb = ru.ru_maxrss;
+#endif
+    struct stat st;
+    r.output_bytes = stat(out_path, &st) == 0 ? (size_t)st.st_size : 0;
+    return r;
+}
+
+static int parse_count(const char *opt, const char *value) {
+    char *end = NULL;
+    long n = strtol(value, &end, 10);
+    if (!end || *end || n < 0 || n > 10000000) {
+        fprintf(stderr, "error: invalid value for %s: %s\n", opt, value);
+        exit(1);
+    }
+    return (int)n;
+}
+
+static void print_help(const char *prog) {
+    printf("Usage: %s [options] [-- <doc_gen options>]\n", prog);
+    printf("Generate a synthetic header corpus and time doc_gen over it.\n\n");
+    printf("Options:\n");
+    printf("  --files N           Number of headers to generate (default 8)\n");
+    printf("  --functions N       Documented functions per header (default 2000)\n");
+    printf("  --macros N          Documented macros per header (default 200)\n");
+    printf("  --typedefs N        Documented typedefs per header (default 200)\n");
+    printf("  --structs N         Documented structs per header (default 200)\n");
+    printf("  --enums N           Documented enums per header (default 100)\n");
+    printf("  --doc-lines N       Prose lines per function comment (default 4)\n");
+    printf("  --code-every N      Give every Nth function an @code block (default 4, 0 = none)\n");
+    printf("  -j, --jobs N        Pass -j N to doc_gen (default 1)\n");
+    printf("  --runs N            Time N runs and report the fastest (default 3)\n");
+    printf("  --dir DIR           Where to write the corpus (default bench/corpus)\n");
+    printf("  --doc-gen PATH      doc_gen binary to run (default ./doc_gen)\n");
+    printf("  --out FILE          Write the JSON result to FILE instead of stdout\n");
+}
+
+int main(int argc, char **argv) {
+    Config cfg = { 8, 2000, 200, 200, 200, 100, 4, 4, 1, 3,
+                   "bench/corpus", "./doc_gen", NULL, 0, NULL };
+    static const struct { const char *name; size_t off; } counts[] = {
+        { "--files", offsetof(Config, files) },
+        { "--functions", offsetof(Config, functions) },
+        { "--macros", offsetof(Config, macros) },
+        { "--typedefs", offsetof(Config, typedefs) },
+        { "--structs", offsetof(Config, structs) },
+        { "--enums", offsetof(Config, enums) },
+        { "--doc-lines", offsetof(Config, doc_lines) },
+        { "--code-every", offsetof(Config, code_every) },
+        { "-j", offsetof(Config, jobs) },
+        { "--jobs", offsetof(Config, jobs) },
+        { "--runs", offsetof(Config, runs) },
+    };
+    int i = 1;
+    for (; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            print_help(argv[0]);
+            return 0;
+        }
+        if (strcmp(arg, "--") == 0) {
+            cfg.extra_argc = argc - i - 1;
+            cfg.extra_argv = argv + i + 1;
+            break;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "error: unknown option or missing value: %s\n", arg);
+            return 1;
+        }
+        bool matched = false;
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+            if (strcmp(arg, counts[c].name) == 0) {
+                *(int*)((char*)&cfg + counts[c].off) = parse_count(arg, argv[i + 1]);
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) {
+            if (strcmp(arg, "--dir") == 0) cfg.dir = argv[i + 1];
+            else if (strcmp(arg, "--doc-gen") == 0) cfg.doc_gen = argv[i + 1];
+            else if (strcmp(arg, "--out") == 0) cfg.out = argv[i + 1];
+            else {
+                fprintf(stderr, "error: unknown option: %s\n", arg);
+                return 1;
+            }
+        }
+        ++i;
+    }
+    if (cfg.files < 1) die("--files must be at least 1");
+    if (cfg.runs < 1) cfg.runs = 1;
+
+    if (mkdir(cfg.dir, 0777) != 0 && errno != EEXIST) die("cannot create corpus directory");
+    char **paths = (char**)calloc((size_t)cfg.files, sizeof(char*));
+    if (!paths) die("out of memory");
+    size_t input_bytes = 0;
+    for (int f = 0; f < cfg.files; ++f) {
+        size_t n = strlen(cfg.dir) + 32;
+        paths[f] = (char*)malloc(n);
+        if (!paths[f]) die("out of memory");
+        snprintf(paths[f], n, "%s/bench_%d.h", cfg.dir, f);
+        input_bytes += write_header(&cfg, f, paths[f]);
+    }
+    size_t out_len = strlen(cfg.dir) + 16;
+    char *out_path = (char*)malloc(out_len);
+    if (!out_path) die("out of memory");
+    snprintf(out_path, out_len, "%s/out.md", cfg.dir);
+
+    RunResult best = { 0, 0, 0 };
+    long peak_rss_kb = 0;
+    for (int r = 0; r < cfg.runs; ++r) {
+        RunResult res = run_doc_gen(&cfg, paths, out_path);
+        fprintf(stderr, "run %d: %.3f s, %ld KiB peak RSS\n", r + 1, res.wall_s, res.peak_rss_kb);
+        if (r == 0 || res.wall_s < best.wall_s) best = res;
+        if (res.peak_rss_kb > peak_rss_kb) peak_rss_kb = res.peak_rss_kb;
+    }
+
+    long symbols = (long)cfg.files *
+                   (cfg.functions + cfg.macros + cfg.typedefs + cfg.structs + cfg.enums);
+    FILE *fp = cfg.out ? fopen(cfg.out, "w") : stdout;
+    if (!fp) die("cannot write --out file");
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"files\": %d,\n", cfg.files);
+    fprintf(fp, "  \"symbols\": %ld,\n", symbols);
+    fprintf(fp, "  \"input_bytes\": %zu,\n", input_bytes);
+    fprintf(fp, "  \"output_bytes\": %zu,\n", best.output_bytes);
+    fprintf(fp, "  \"jobs\": %d,\n", cfg.jobs);
+    fprintf(fp, "  \"runs\": %d,\n", cfg.runs);
+    fprintf(fp, "  \"wall_s\": %.6f,\n", best.wall_s);
+    fprintf(fp, "  \"files_per_s\": %.2f,\n", cfg.files / best.wall_s);
+    fprintf(fp, "  \"symbols_per_s\": %.1f,\n", symbols / best.wall_s);
+    fprintf(fp, "  \"output_mb_per_s\": %.3f,\n", best.output_bytes / 1e6 / best.wall_s);
+    fprintf(fp, "  \"peak_rss_kb\": %ld\n", peak_rss_kb);
+    fprintf(fp, "}\n");
+    if (cfg.out) fclose(fp);
+
+    for (int f = 0; f < cfg.files; ++f) free(paths[f]);
+    free(paths);
+    free(out_path);
+    return 0;
+}
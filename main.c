@@ -23,15 +23,45 @@
  * See <https://creativecommons.org/publicdomain/zero/1.0/> for details.
  */
 
+#define _POSIX_C_SOURCE 200809L
+#define _DARWIN_C_SOURCE
+
 #include <clang-c/Index.h>
+#include <clang-c/CXCompilationDatabase.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#endif
 
-#define DOCSTRING_START "<!--DOCSTRING_START-->"
-#define DOCSTRING_END   "<!--DOCSTRING_END-->"
+#ifdef DOC_GEN_ALLOC_COUNT
+/* Build with -DDOC_GEN_ALLOC_COUNT to count this program's own heap
+ * allocations (libclang's are not included). The total is printed on exit. */
+static atomic_size_t g_alloc_count;
+static void *counted_malloc(size_t n) { atomic_fetch_add_explicit(&g_alloc_count, 1, memory_order_relaxed); return malloc(n); }
+static void *counted_calloc(size_t n, size_t m) { atomic_fetch_add_explicit(&g_alloc_count, 1, memory_order_relaxed); return calloc(n, m); }
+static void *counted_realloc(void *p, size_t n) { atomic_fetch_add_explicit(&g_alloc_count, 1, memory_order_relaxed); return realloc(p, n); }
+static char *counted_strdup(const char *s) { atomic_fetch_add_explicit(&g_alloc_count, 1, memory_order_relaxed); return strdup(s); }
+#define malloc(n) counted_malloc(n)
+#define calloc(n, m) counted_calloc(n, m)
+#define realloc(p, n) counted_realloc(p, n)
+#define strdup(s) counted_strdup(s)
+#endif
 
 static void die(const char *msg);
 static char *dup_range(const char *src, size_t len);
@@ -45,6 +75,12 @@ typedef struct {
     char *name;
     char *anchor;
     char *kind;
+    int file; // input that documents it
+    // Only filled in for --emit-index.
+    const char *usr; // registry-owned
+    char *decl; // prototype or definition, one line
+    char *path; // "Defined at" location
+    unsigned line;
 } Entry;
 
 typedef struct {
@@ -86,21 +122,26 @@ static void sb_append(StrBuf *sb, const char *s) {
     sb_append_n(sb, s, strlen(s));
 }
 
+static void sb_appendf(StrBuf *sb, const char *fmt, ...) {
+    va_list ap, ap2;
+    va_start(ap, fmt);
+    va_copy(ap2, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        sb_reserve(sb, (size_t)n);
+        vsnprintf(sb->buf + sb->len, (size_t)n + 1, fmt, ap2);
+        sb->len += (size_t)n;
+    }
+    va_end(ap2);
+}
+
 static void sb_append_char(StrBuf *sb, char c) {
     sb_reserve(sb, 1);
     sb->buf[sb->len++] = c;
     sb->buf[sb->len] = '\0';
 }
 
-static void sb_trim_trailing_space(StrBuf *sb) {
-    while (sb->len > 0) {
-        char c = sb->buf[sb->len - 1];
-        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
-        sb->len--;
-    }
-    if (sb->buf) sb->buf[sb->len] = '\0';
-}
-
 static void trim_trailing_space(char *s) {
     if (!s) return;
     size_t len = strlen(s);
@@ -111,27 +152,209 @@ static void trim_trailing_space(char *s) {
     }
 }
 
-static void sb_ensure_blank_line(StrBuf *sb) {
-    if (sb->len == 0) return;
-    if (sb->len >= 2 && sb->buf[sb->len - 1] == '\n' && sb->buf[sb->len - 2] == '\n')
-        return;
-    if (sb->buf[sb->len - 1] != '\n') sb_append_char(sb, '\n');
-    if (sb->len < 2 || sb->buf[sb->len - 2] != '\n') sb_append_char(sb, '\n');
+/* Bump allocator for strings that only live while one translation unit is
+ * rendered: cursor names, USRs, type spellings, anchors, token text. Each
+ * thread has its own, reset after the TU is disposed. Blocks are kept across
+ * resets, so once a worker has seen its largest TU these stop hitting malloc. */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t cap, used;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head, *cur;
+} Arena;
+
+static _Thread_local Arena t_arena;
+
+static void *arena_alloc(Arena *a, size_t n) {
+    n = (n + 7) & ~(size_t)7;
+    ArenaBlock *b = a->cur;
+    // Blocks after `cur` are left over from before the last reset.
+    while (b && b->cap - b->used < n) {
+        b = b->next;
+        if (b) b->used = 0;
+    }
+    if (!b) {
+        size_t cap = n > ARENA_BLOCK_SIZE ? n : ARENA_BLOCK_SIZE;
+        b = (ArenaBlock*)malloc(sizeof(ArenaBlock) + cap);
+        if (!b) die("out of memory");
+        b->cap = cap;
+        b->used = 0;
+        if (a->cur) {
+            b->next = a->cur->next;
+            a->cur->next = b;
+        } else {
+            b->next = a->head;
+            a->head = b;
+        }
+    }
+    a->cur = b;
+    void *p = b->data + b->used;
+    b->used += n;
+    return p;
+}
+
+static char *arena_dup(Arena *a, const char *s, size_t len) {
+    char *r = (char*)arena_alloc(a, len + 1);
+    memcpy(r, s, len);
+    r[len] = '\0';
+    return r;
+}
+
+/* Release everything allocated since the last reset, keeping the blocks. */
+static void arena_reset(Arena *a) {
+    if (a->head) a->head->used = 0;
+    a->cur = a->head;
+}
+
+static void arena_free(Arena *a) {
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = a->cur = NULL;
+}
+
+/* --stats: per-input phase timings and counters. Phases are exclusive: a
+ * nested phase (normalising a comment while visiting) pauses the outer one,
+ * so the columns add up to the time spent. */
+typedef enum {
+    PHASE_FILE_DOC,
+    PHASE_PARSE,
+    PHASE_VISIT,
+    PHASE_NORMALIZE,
+    PHASE_DOXYGEN,
+    PHASE_LINK,
+    PHASE_WRITE,
+    PHASE_COUNT
+} Phase;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "file-doc", "parse", "visit", "normalize", "doxygen", "link", "write"
+};
+
+typedef struct {
+    uint64_t wall[PHASE_COUNT], cpu[PHASE_COUNT];
+    uint64_t cursors, pruned, dedupe_hits, emitted[3];
+    uint64_t link_lookups, link_hits, bytes;
+} Stats;
+
+static bool g_stats;
+// The Stats being filled on this thread, NULL when --stats is off.
+static _Thread_local Stats *t_stats;
+static _Thread_local Phase t_phase = PHASE_COUNT;
+static _Thread_local uint64_t t_phase_wall, t_phase_cpu;
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void stats_charge(uint64_t wall, uint64_t cpu) {
+    if (t_phase != PHASE_COUNT) {
+        t_stats->wall[t_phase] += wall - t_phase_wall;
+        t_stats->cpu[t_phase] += cpu - t_phase_cpu;
+    }
+    t_phase_wall = wall;
+    t_phase_cpu = cpu;
+}
+
+/* Switch this thread to phase p; pass the result to stats_leave. */
+static Phase stats_enter(Phase p) {
+    if (!t_stats) return PHASE_COUNT;
+    stats_charge(clock_ns(CLOCK_MONOTONIC), clock_ns(CLOCK_THREAD_CPUTIME_ID));
+    Phase outer = t_phase;
+    t_phase = p;
+    return outer;
+}
+
+static void stats_leave(Phase outer) {
+    if (!t_stats) return;
+    stats_charge(clock_ns(CLOCK_MONOTONIC), clock_ns(CLOCK_THREAD_CPUTIME_ID));
+    t_phase = outer;
+}
+
+/* --trace-out: complete ("X") events in the Chrome trace-event format,
+ * readable by chrome://tracing and Perfetto. Events are formatted as they
+ * end and appended to one buffer; there are only a handful per input. */
+static struct {
+    const char *path;
+    uint64_t t0;
+    StrBuf events;
+    int next_tid;
+    pthread_mutex_t lock;
+} g_trace = { NULL, 0, { NULL, 0, 0 }, 0, PTHREAD_MUTEX_INITIALIZER };
+static _Thread_local int t_trace_tid = -1;
+
+/* Start of a span, or 0 when tracing is off. */
+static uint64_t trace_begin(void) {
+    return g_trace.path ? clock_ns(CLOCK_MONOTONIC) : 0;
+}
+
+static void sb_append_json_string(StrBuf *sb, const char *s) {
+    sb_append_char(sb, '"');
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            sb_append_char(sb, '\\');
+            sb_append_char(sb, (char)c);
+        } else if (c < 0x20) {
+            sb_appendf(sb, "\\u%04x", c);
+        } else {
+            sb_append_char(sb, (char)c);
+        }
+    }
+    sb_append_char(sb, '"');
 }
 
-static void sb_append_code_block(StrBuf *sb, const char *code, const char *lang) {
-    if (!code) code = "";
-    sb_ensure_blank_line(sb);
-    sb_append(sb, "```");
-    if (lang && *lang) {
-        if (lang[0] == '.') lang++;
-        sb_append(sb, lang);
+/* Give this thread a trace id and a name. Called with the lock held. */
+static void trace_register_thread(const char *name) {
+    StrBuf *sb = &g_trace.events;
+    t_trace_tid = g_trace.next_tid++;
+    sb_appendf(sb, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,"
+               "\"args\":{\"name\":\"%s %d\"}}",
+               sb->len ? ",\n" : "", t_trace_tid, name, t_trace_tid);
+}
+
+/* Close a span opened with trace_begin. `path` and the `counter` = n pair
+ * become the event's args; either may be omitted with NULL. */
+static void trace_end(const char *name, uint64_t start, const char *path,
+                      const char *counter, uint64_t n) {
+    if (!start) return;
+    uint64_t end = clock_ns(CLOCK_MONOTONIC);
+    pthread_mutex_lock(&g_trace.lock);
+    StrBuf *sb = &g_trace.events;
+    if (t_trace_tid < 0) trace_register_thread("worker");
+    sb_appendf(sb, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+               sb->len ? ",\n" : "", name, t_trace_tid,
+               (double)(start - g_trace.t0) / 1e3, (double)(end - start) / 1e3);
+    if (path) {
+        sb_append(sb, "\"path\":");
+        sb_append_json_string(sb, path);
+    }
+    if (counter) sb_appendf(sb, "%s\"%s\":%llu", path ? "," : "", counter, (unsigned long long)n);
+    sb_append(sb, "}}");
+    pthread_mutex_unlock(&g_trace.lock);
+}
+
+static void trace_write(void) {
+    FILE *fp = fopen(g_trace.path, "wb");
+    if (!fp) {
+        fprintf(stderr, "warning: cannot write trace to %s\n", g_trace.path);
+        return;
     }
-    sb_append(sb, "\n");
-    sb_append(sb, code);
-    size_t clen = strlen(code);
-    if (clen == 0 || code[clen - 1] != '\n') sb_append_char(sb, '\n');
-    sb_append(sb, "```\n");
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+    if (g_trace.events.len) fwrite(g_trace.events.buf, 1, g_trace.events.len, fp);
+    fputs("\n]}\n", fp);
+    fclose(fp);
+    sb_free(&g_trace.events);
 }
 
 static char *sb_detach(StrBuf *sb) {
@@ -143,275 +366,426 @@ static char *sb_detach(StrBuf *sb) {
     return out;
 }
 
-typedef struct {
-    char *name;
-    StrBuf desc;
-} ParamDoc;
+/* Doxygen tags understood in comments. DOX_TEXT is plain text, and also the
+ * kind of the untagged lines a comment starts with. */
+typedef enum {
+    DOX_TEXT,
+    DOX_CODE,
+    DOX_FILE,
+    DOX_BRIEF,
+    DOX_PARAM,
+    DOX_RETURN,
+    DOX_RETVAL,
+    DOX_PRE,
+    DOX_NOTE,
+    DOX_WARNING,
+    DOX_SEE
+} DoxTag;
 
-typedef struct {
-    ParamDoc *data;
-    size_t n, cap;
-} ParamVec;
+/* Tag names, best kept grouped by first letter; dox_tag only compares the
+ * rows between the first and last name starting with the tag's letter, and
+ * only those of matching length. */
+static const struct {
+    const char *name;
+    size_t len;
+    DoxTag tag;
+} dox_tags[] = {
+    { "brief", 5, DOX_BRIEF },
+    { "code", 4, DOX_CODE },
+    { "file", 4, DOX_FILE },
+    { "note", 4, DOX_NOTE },
+    { "pre", 3, DOX_PRE }, { "param", 5, DOX_PARAM }, { "params", 6, DOX_PARAM },
+    { "return", 6, DOX_RETURN }, { "retval", 6, DOX_RETVAL }, { "returns", 7, DOX_RETURN },
+    { "sa", 2, DOX_SEE }, { "see", 3, DOX_SEE },
+    { "warning", 7, DOX_WARNING },
+};
 
-static ParamDoc *paramvec_push(ParamVec *vec, const char *name) {
-    if (vec->n == vec->cap) {
-        vec->cap = vec->cap ? vec->cap * 2 : 8;
-        vec->data = (ParamDoc*)realloc(vec->data, vec->cap * sizeof(ParamDoc));
-        if (!vec->data) die("out of memory");
+#define DOX_NTAGS (sizeof(dox_tags) / sizeof(dox_tags[0]))
+
+/* Per letter a-z, the dox_tags rows [lo, hi) to compare; built from the
+ * table on first use so the table is the only thing to edit. */
+static struct { unsigned char lo, hi; } dox_letter[26];
+static pthread_once_t dox_letter_once = PTHREAD_ONCE_INIT;
+
+static void dox_letter_build(void) {
+    for (size_t i = 0; i < DOX_NTAGS; ++i) {
+        int c = dox_tags[i].name[0] - 'a';
+        if (dox_letter[c].hi == 0) dox_letter[c].lo = (unsigned char)i;
+        dox_letter[c].hi = (unsigned char)(i + 1);
     }
-    ParamDoc *entry = &vec->data[vec->n++];
-    entry->name = strdup(name ? name : "");
-    entry->desc.buf = NULL;
-    entry->desc.len = entry->desc.cap = 0;
-    return entry;
 }
 
-static void paramvec_free(ParamVec *vec) {
-    for (size_t i = 0; i < vec->n; ++i) {
-        free(vec->data[i].name);
-        sb_free(&vec->data[i].desc);
+/* Classify a trimmed line. On a tag, *after points just past its name. */
+static DoxTag dox_tag(const char *p, const char *eol, const char **after) {
+    if (p + 1 >= eol || p[0] != '@') return DOX_TEXT;
+    const char *w = p + 1;
+    const char *e = w;
+    while (e < eol && *e >= 'a' && *e <= 'z') e++;
+    size_t n = (size_t)(e - w);
+    if (n == 0) return DOX_TEXT;
+    pthread_once(&dox_letter_once, dox_letter_build);
+    for (size_t i = dox_letter[*w - 'a'].lo; i < dox_letter[*w - 'a'].hi; ++i) {
+        if (dox_tags[i].len != n || memcmp(dox_tags[i].name, w, n) != 0) continue;
+        DoxTag tag = dox_tags[i].tag;
+        bool boundary = e == eol || isspace((unsigned char)*e) || (tag == DOX_CODE && *e == '{');
+        if (!boundary) return DOX_TEXT;
+        *after = e;
+        return tag;
     }
-    free(vec->data);
-    vec->data = NULL;
-    vec->n = vec->cap = 0;
+    return DOX_TEXT;
 }
 
-typedef struct {
-    StrBuf text;
-    bool has;
-} SectionDoc;
-
-static StrBuf *section_begin(SectionDoc *sec) {
-    if (sec->has && sec->text.len > 0) sb_append(&sec->text, "\n\n");
-   sec->has = true;
-   return &sec->text;
-}
-
-static void append_param_desc(StrBuf *dest, const char *desc) {
-    if (!desc || !*desc) return;
-    for (const char *p = desc; *p; ++p) {
-        if (*p == '\n') {
-            sb_append_char(dest, '\n');
-            sb_append(dest, "  ");
-        } else {
-            sb_append_char(dest, *p);
-        }
-    }
+/* Split off one line: returns the start of the next one, or NULL after the
+ * last. A trailing newline leaves one empty final line, as strtok-style
+ * splitting would. */
+static const char *dox_line(const char *line, const char *end, const char **eol) {
+    const char *nl = (const char*)memchr(line, '\n', (size_t)(end - line));
+    *eol = nl ? nl : end;
+    return nl ? nl + 1 : NULL;
 }
 
-static char *doxygen_to_markdown(const char *text) {
-    if (!text || !*text) return NULL;
+static const char *dox_skip_blanks(const char *p, const char *eol) {
+    while (p < eol && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
 
-    StrBuf general = {0};
-    ParamVec params = {0};
-    SectionDoc returns = {0}, notes = {0}, warnings = {0};
-    StrBuf *current_buf = &general;
-
-    char *copy = strdup(text);
-    if (!copy) die("out of memory");
-    char *cursor = copy;
-    while (cursor) {
-        char *line = cursor;
-        char *newline = strchr(cursor, '\n');
-        if (newline) { *newline = '\0'; cursor = newline + 1; }
-        else cursor = NULL;
-
-        char *trim = line;
-        while (*trim == ' ' || *trim == '\t') trim++;
-
-        if (strncmp(trim, "@code", 5) == 0 && (trim[5] == '\0' || isspace((unsigned char)trim[5]) || trim[5] == '{')) {
-            char *lang = NULL;
-            const char *lang_start = trim + 5;
-            while (*lang_start == ' ' || *lang_start == '\t') lang_start++;
-            if (*lang_start == '{') {
-                const char *close = strchr(lang_start, '}');
-                if (close && close > lang_start + 1) lang = dup_range(lang_start + 1, (size_t)(close - lang_start - 1));
-            } else if (*lang_start) {
-                lang = strdup(lang_start);
-            }
+/* A tag line and the lines after it, up to the next tag. Everything points
+ * into the comment text. */
+typedef struct {
+    DoxTag tag;
+    const char *name, *name_end; // @param / @retval
+    const char *desc, *desc_end; // rest of the tag line
+    const char *body;            // first following line, NULL if none
+    const char *stop;            // the next block's tag line, NULL at the end
+} DoxBlock;
 
-            StrBuf code = {0};
-            while (cursor) {
-                char *code_line = cursor;
-                char *code_newline = strchr(cursor, '\n');
-                if (code_newline) { *code_newline = '\0'; cursor = code_newline + 1; }
-                else cursor = NULL;
-                char *code_trim = code_line;
-                while (*code_trim == ' ' || *code_trim == '\t') code_trim++;
-                if (strncmp(code_trim, "@endcode", 8) == 0) {
-                    break;
-                }
-                sb_append(&code, code_line);
-                sb_append_char(&code, '\n');
-            }
-            sb_append_code_block(current_buf, code.buf ? code.buf : "", lang);
-            sb_free(&code);
-            free(lang);
-            continue;
-        }
+/* Markdown goes into one buffer sized up front. Sections are trimmed in
+ * place; parameter descriptions indent their continuation lines as they are
+ * written, while blank-line decisions look at the unindented text. */
+typedef struct {
+    char *buf;
+    size_t pos, cap;
+    bool indent;
+    size_t raw_len;
+    char tail[2];
+} MdWriter;
 
-        bool handled = false;
-        if ((strncmp(trim, "@param", 6) == 0 && (trim[6] == '\0' || isspace((unsigned char)trim[6]))) ||
-            (strncmp(trim, "@params", 7) == 0 && (trim[7] == '\0' || isspace((unsigned char)trim[7])))) {
-            const char *rest = trim + ((trim[6] == 's') ? 7 : 6);
-            while (*rest == ' ' || *rest == '\t') rest++;
-            const char *name_start = rest;
-            while (*name_start == ' ' || *name_start == '\t') name_start++;
-            const char *name_end = name_start;
-            while (*name_end && !isspace((unsigned char)*name_end)) name_end++;
-            char *name = NULL;
-            if (name_end > name_start) name = dup_range(name_start, (size_t)(name_end - name_start));
-            ParamDoc *param = paramvec_push(&params, name ? name : "");
-            free(name);
-            const char *desc_start = name_end;
-            while (*desc_start == ' ' || *desc_start == '\t') desc_start++;
-            if (*desc_start) {
-                sb_append(&param->desc, desc_start);
-                sb_append_char(&param->desc, '\n');
-            }
-            current_buf = &param->desc;
-            handled = true;
-        } else if ((strncmp(trim, "@return", 7) == 0 && (trim[7] == '\0' || isspace((unsigned char)trim[7]))) ||
-                   (strncmp(trim, "@returns", 8) == 0 && (trim[8] == '\0' || isspace((unsigned char)trim[8])))) {
-            const char *desc = trim + ((trim[7] == 's') ? 8 : 7);
-            while (*desc == ' ' || *desc == '\t') desc++;
-            StrBuf *target = section_begin(&returns);
-            if (*desc) {
-                sb_append(target, desc);
-                sb_append_char(target, '\n');
-            }
-            current_buf = target;
-            handled = true;
-        } else if (strncmp(trim, "@note", 5) == 0 && (trim[5] == '\0' || isspace((unsigned char)trim[5]))) {
-            const char *desc = trim + 5;
-            while (*desc == ' ' || *desc == '\t') desc++;
-            StrBuf *target = section_begin(&notes);
-            if (*desc) {
-                sb_append(target, desc);
-                sb_append_char(target, '\n');
-            }
-            current_buf = target;
-            handled = true;
-        } else if (strncmp(trim, "@warning", 8) == 0 && (trim[8] == '\0' || isspace((unsigned char)trim[8]))) {
-            const char *desc = trim + 8;
-            while (*desc == ' ' || *desc == '\t') desc++;
-            StrBuf *target = section_begin(&warnings);
-            if (*desc) {
-                sb_append(target, desc);
-                sb_append_char(target, '\n');
+static void md_put(MdWriter *w, const char *s, size_t n) {
+    if (n == 0) return;
+    size_t need = w->pos + n * 3 + 1;
+    if (need > w->cap) {
+        // The size estimate covers every comment shape we know of; this is
+        // only a safety net.
+        w->cap = need * 2;
+        w->buf = (char*)realloc(w->buf, w->cap);
+        if (!w->buf) die("out of memory");
+    }
+    if (!w->indent) {
+        memcpy(w->buf + w->pos, s, n);
+        w->pos += n;
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            w->buf[w->pos++] = s[i];
+            if (s[i] == '\n') {
+                w->buf[w->pos++] = ' ';
+                w->buf[w->pos++] = ' ';
             }
-            current_buf = target;
-            handled = true;
         }
+    }
+    if (n >= 2) w->tail[0] = s[n - 2];
+    else w->tail[0] = w->tail[1];
+    w->tail[1] = s[n - 1];
+    w->raw_len += n;
+}
+
+static void md_lit(MdWriter *w, const char *s) { md_put(w, s, strlen(s)); }
+
+static void md_begin(MdWriter *w, bool indent) {
+    w->indent = indent;
+    w->raw_len = 0;
+    w->tail[0] = w->tail[1] = '\0';
+}
+
+static void md_trim(MdWriter *w, size_t start) {
+    while (w->pos > start) {
+        char c = w->buf[w->pos - 1];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') break;
+        w->pos--;
+    }
+}
 
-        if (handled) continue;
+static void md_blank_line(MdWriter *w) {
+    if (w->raw_len == 0) return;
+    if (w->raw_len >= 2 && w->tail[0] == '\n' && w->tail[1] == '\n') return;
+    if (w->tail[1] != '\n') md_put(w, "\n", 1);
+    if (w->raw_len < 2 || w->tail[0] != '\n') md_put(w, "\n", 1);
+}
 
-        if (*trim == '\0') {
-            if (current_buf) sb_append_char(current_buf, '\n');
+/* Emit a @code ... @endcode block starting at `line`; returns the line after
+ * it. */
+static const char *md_code(MdWriter *w, const char *after_tag, const char *eol, const char *line_next, const char *end) {
+    const char *lang = dox_skip_blanks(after_tag, eol);
+    const char *lang_end = lang;
+    if (lang < eol && *lang == '{') {
+        const char *close = (const char*)memchr(lang, '}', (size_t)(eol - lang));
+        if (close && close > lang + 1) {
+            lang_end = close;
+            lang++;
         } else {
-            if (!current_buf) current_buf = &general;
-            sb_append(current_buf, trim);
-            sb_append_char(current_buf, '\n');
+            lang = lang_end;
         }
+    } else {
+        lang_end = eol;
     }
-    free(copy);
-
-    sb_trim_trailing_space(&general);
-    if (returns.has) sb_trim_trailing_space(&returns.text);
-    if (notes.has) sb_trim_trailing_space(&notes.text);
-    if (warnings.has) sb_trim_trailing_space(&warnings.text);
-    for (size_t i = 0; i < params.n; ++i) sb_trim_trailing_space(&params.data[i].desc);
+    if (lang < lang_end && *lang == '.') lang++;
 
-    StrBuf final = {0};
-    if (general.len) sb_append(&final, general.buf);
+    md_blank_line(w);
+    md_lit(w, "```");
+    md_put(w, lang, (size_t)(lang_end > lang ? lang_end - lang : 0));
+    md_lit(w, "\n");
+    bool any = false;
+    const char *line = line_next;
+    while (line) {
+        const char *code_eol;
+        const char *next = dox_line(line, end, &code_eol);
+        const char *trim = dox_skip_blanks(line, code_eol);
+        if ((size_t)(code_eol - trim) >= 8 && memcmp(trim, "@endcode", 8) == 0) {
+            line = next;
+            break;
+        }
+        md_put(w, line, (size_t)(code_eol - line));
+        md_lit(w, "\n");
+        any = true;
+        line = next;
+    }
+    if (!any) md_lit(w, "\n");
+    md_lit(w, "```\n");
+    return line;
+}
 
-    if (params.n) {
-        if (final.len) sb_append(&final, "\n\n");
-        sb_append(&final, "#### Parameters\n\n");
-        for (size_t i = 0; i < params.n; ++i) {
-            ParamDoc *p = &params.data[i];
-            sb_append(&final, "**");
-            sb_append(&final, p->name);
-            sb_append(&final, "** \xE2\x80\x94 ");
-            if (p->desc.len) append_param_desc(&final, p->desc.buf);
-            sb_append(&final, "\n\n");
+static void md_block(MdWriter *w, const DoxBlock *b, const char *end) {
+    if (b->desc < b->desc_end) {
+        md_put(w, b->desc, (size_t)(b->desc_end - b->desc));
+        md_lit(w, "\n");
+    }
+    const char *line = b->body;
+    while (line && line != b->stop) {
+        const char *eol;
+        const char *next = dox_line(line, end, &eol);
+        const char *trim = dox_skip_blanks(line, eol);
+        const char *after = NULL;
+        if (dox_tag(trim, eol, &after) == DOX_CODE) {
+            line = md_code(w, after, eol, next, end);
+            continue;
         }
+        if (trim < eol) md_put(w, trim, (size_t)(eol - trim));
+        md_lit(w, "\n");
+        line = next;
     }
+}
 
-    if (returns.has && returns.text.len) {
-        if (final.len) sb_append(&final, "\n\n");
-        sb_append(&final, "#### Returns\n\n");
-        sb_append(&final, returns.text.buf);
+/* A titled section holding every block with `tag`, blank-line separated.
+ * Dropped entirely when it ends up empty. */
+static void md_section(MdWriter *w, const DoxBlock *blocks, size_t n, DoxTag tag, const char *title, const char *end) {
+    size_t mark = w->pos;
+    if (w->pos) md_lit(w, "\n\n");
+    md_lit(w, title);
+    size_t start = w->pos;
+    md_begin(w, false);
+    bool any = false;
+    for (size_t i = 0; i < n; ++i) {
+        if (blocks[i].tag != tag) continue;
+        if (any && w->raw_len > 0) md_lit(w, "\n\n");
+        any = true;
+        md_block(w, &blocks[i], end);
     }
-    if (notes.has && notes.text.len) {
-        if (final.len) sb_append(&final, "\n\n");
-        sb_append(&final, "#### Note\n\n");
-        sb_append(&final, notes.text.buf);
+    md_trim(w, start);
+    if (w->pos == start) w->pos = mark;
+}
+
+/* "**name** — description" entries, as for @param and @retval. */
+static void md_list(MdWriter *w, const DoxBlock *blocks, size_t n, DoxTag tag, const char *title, const char *end) {
+    bool any = false;
+    for (size_t i = 0; i < n; ++i) {
+        if (blocks[i].tag != tag) continue;
+        if (!any) {
+            if (w->pos) md_lit(w, "\n\n");
+            md_lit(w, title);
+            any = true;
+        }
+        md_lit(w, "**");
+        md_put(w, blocks[i].name, (size_t)(blocks[i].name_end - blocks[i].name));
+        md_lit(w, "** \xE2\x80\x94 ");
+        size_t start = w->pos;
+        md_begin(w, true);
+        md_block(w, &blocks[i], end);
+        md_trim(w, start);
+        md_begin(w, false);
+        md_lit(w, "\n\n");
     }
-    if (warnings.has && warnings.text.len) {
-        if (final.len) sb_append(&final, "\n\n");
-        sb_append(&final, "#### Warning\n\n");
-        sb_append(&final, warnings.text.buf);
+}
+
+/* Render a normalised comment as Markdown. Tags are found with dox_tag and
+ * their text is kept as spans into `text` until the single output buffer is
+ * written. */
+static char *doxygen_to_markdown(const char *text, size_t len) {
+    if (!text || len == 0) return NULL;
+    const char *end = text + len;
+
+    DoxBlock stack_blocks[16];
+    DoxBlock *blocks = stack_blocks;
+    size_t nblocks = 1, cap = sizeof(stack_blocks) / sizeof(stack_blocks[0]);
+    size_t ncode = 0;
+    memset(&blocks[0], 0, sizeof(blocks[0]));
+    blocks[0].tag = DOX_TEXT;
+    blocks[0].body = text;
+
+    const char *line = text;
+    while (line) {
+        const char *eol;
+        const char *next = dox_line(line, end, &eol);
+        const char *trim = dox_skip_blanks(line, eol);
+        const char *after = NULL;
+        DoxTag tag = dox_tag(trim, eol, &after);
+        if (tag == DOX_CODE) {
+            // Tags inside a code block are code.
+            ncode++;
+            line = next;
+            while (line) {
+                const char *code_eol;
+                const char *code_next = dox_line(line, end, &code_eol);
+                const char *code_trim = dox_skip_blanks(line, code_eol);
+                line = code_next;
+                if ((size_t)(code_eol - code_trim) >= 8 && memcmp(code_trim, "@endcode", 8) == 0) break;
+            }
+            continue;
+        }
+        if (tag != DOX_TEXT) {
+            if (nblocks == cap) {
+                cap *= 2;
+                if (blocks == stack_blocks) {
+                    blocks = (DoxBlock*)malloc(cap * sizeof(DoxBlock));
+                    if (!blocks) die("out of memory");
+                    memcpy(blocks, stack_blocks, sizeof(stack_blocks));
+                } else {
+                    blocks = (DoxBlock*)realloc(blocks, cap * sizeof(DoxBlock));
+                    if (!blocks) die("out of memory");
+                }
+            }
+            blocks[nblocks - 1].stop = line;
+            DoxBlock *b = &blocks[nblocks++];
+            memset(b, 0, sizeof(*b));
+            b->tag = tag;
+            const char *rest = dox_skip_blanks(after, eol);
+            if (tag == DOX_PARAM || tag == DOX_RETVAL) {
+                b->name = rest;
+                while (rest < eol && !isspace((unsigned char)*rest)) rest++;
+                b->name_end = rest;
+                rest = dox_skip_blanks(rest, eol);
+            }
+            // @file only names the file, which the heading already shows.
+            if (tag != DOX_FILE) {
+                b->desc = rest;
+                b->desc_end = eol;
+            }
+            b->body = next;
+        }
+        line = next;
     }
 
-    sb_trim_trailing_space(&final);
+    // Every input byte is written at most once, plus two spaces per indented
+    // newline; fences, headings and separators are bounded per block.
+    MdWriter w = {0};
+    w.cap = len * 3 + (nblocks + ncode) * 64 + 256;
+    w.buf = (char*)malloc(w.cap);
+    if (!w.buf) die("out of memory");
 
-    char *result = NULL;
-    if (final.len) result = sb_detach(&final);
+    md_begin(&w, false);
+    for (size_t i = 0; i < nblocks; ++i) {
+        DoxTag tag = blocks[i].tag;
+        if (tag != DOX_TEXT && tag != DOX_FILE && tag != DOX_BRIEF) continue;
+        if (tag == DOX_BRIEF) md_blank_line(&w);
+        md_block(&w, &blocks[i], end);
+    }
+    md_trim(&w, 0);
+    md_list(&w, blocks, nblocks, DOX_PARAM, "#### Parameters\n\n", end);
+    md_section(&w, blocks, nblocks, DOX_RETURN, "#### Returns\n\n", end);
+    md_list(&w, blocks, nblocks, DOX_RETVAL, "#### Return values\n\n", end);
+    md_section(&w, blocks, nblocks, DOX_PRE, "#### Precondition\n\n", end);
+    md_section(&w, blocks, nblocks, DOX_NOTE, "#### Note\n\n", end);
+    md_section(&w, blocks, nblocks, DOX_WARNING, "#### Warning\n\n", end);
+    md_section(&w, blocks, nblocks, DOX_SEE, "#### See also\n\n", end);
+    md_trim(&w, 0);
 
-    sb_free(&general);
-    paramvec_free(&params);
-    sb_free(&returns.text);
-    sb_free(&notes.text);
-    sb_free(&warnings.text);
-    sb_free(&final);
-    return result;
+    if (blocks != stack_blocks) free(blocks);
+    if (w.pos == 0) {
+        free(w.buf);
+        return NULL;
+    }
+    w.buf[w.pos] = '\0';
+    return w.buf;
 }
 
+typedef enum {
+    SECTION_MACRO,
+    SECTION_TYPE,
+    SECTION_FUNCTION
+} SectionKind;
+
+/* One documented symbol inside a FileResult. Its text runs from `off` to the
+ * next section's offset (or the end of the buffer). */
 typedef struct {
-    char *name;
-    char *doc;
-} FileDoc;
+    size_t off;
+    const char *usr; // registry-owned key, NULL when the cursor has no USR
+    uint64_t usr_hash;
+    SectionKind kind;
+    Entry entry;
+} Section;
 
 typedef struct {
-    FileDoc *data;
+    Section *data;
     size_t n, cap;
-} FileDocVec;
+} SectionVec;
 
-static void filedocs_add(FileDocVec *vec, const char *path, char *doc) {
-    if (!doc) return;
-    if (vec->n == vec->cap) {
-        vec->cap = vec->cap ? vec->cap * 2 : 8;
-        vec->data = (FileDoc*)realloc(vec->data, vec->cap * sizeof(FileDoc));
-        if (!vec->data) die("out of memory");
-    }
-    const char *slash = strrchr(path, '/');
-    const char *bslash = strrchr(path, '\\');
-    const char *base = path;
-    if (slash && bslash) base = (slash > bslash) ? slash + 1 : bslash + 1;
-    else if (slash) base = slash + 1;
-    else if (bslash) base = bslash + 1;
-    char *name = strdup(base);
-    if (!name) die("out of memory");
-    vec->data[vec->n].name = name;
-    vec->data[vec->n].doc = doc;
-    vec->n++;
-}
+/* A docstring inside a FileResult's buffer. Symbol names in it are turned
+ * into links when the document is written, once every anchor is known. */
+typedef struct {
+    size_t off, len;
+} DocSpan;
 
-static void filedocs_free(FileDocVec *vec) {
-    for (size_t i = 0; i < vec->n; ++i) {
-        free(vec->data[i].name);
-        free(vec->data[i].doc);
-    }
-    free(vec->data);
-    vec->data = NULL;
-    vec->n = vec->cap = 0;
-}
+typedef struct {
+    DocSpan *data;
+    size_t n, cap;
+} DocSpanVec;
+
+/* Everything one input contributes to the document. Workers fill these in
+ * independently and main merges them in command-line order. */
+typedef struct {
+    const char *path;
+    int index;
+    StrBuf out;
+    SectionVec sections;
+    DocSpanVec docs;
+    Stats stats;
+    // Arguments from --compdb for this input, owned; NULL means the shared
+    // clang arguments apply.
+    char **args;
+    int nargs;
+    char *compdb_path; // owned copy of `path` when it came from --compdb
+    uint64_t parse_ns; // parse and visit time; 0 when served from the cache
+    uint64_t cost;     // expected cost, for scheduling
+    // --watch: the live TU, the files it was built from, and its linked
+    // output from the last write, reused until something it depends on
+    // changes.
+    CXTranslationUnit tu;
+    StrSet deps;
+    StrBuf linked;
+    uint64_t kept_hash; // which sections were kept when `linked` was built
+    bool dirty;
+} FileResult;
 
-static FILE *g_out;
 static EntryVec g_macros, g_types, g_functions;
 static StrSet g_ignore_patterns;
-static FileDocVec g_file_docs;
 
 static void die(const char *msg) { fprintf(stderr, "error: %s\n", msg); exit(1); }
 
@@ -420,46 +794,25 @@ static bool cursor_is_in_system_header(CXCursor c) {
     return clang_Location_isInSystemHeader(loc);
 }
 
-static void entryvec_add(EntryVec *vec, const char *name, const char *anchor, const char *kind) {
-    if (vec->n == vec->cap) {
-        vec->cap = vec->cap ? vec->cap * 2 : 64;
-        vec->data = (Entry*)realloc(vec->data, vec->cap * sizeof(Entry));
-    }
-    vec->data[vec->n].name = strdup(name);
-    vec->data[vec->n].anchor = strdup(anchor);
-    vec->data[vec->n].kind = (kind && *kind) ? strdup(kind) : NULL;
-    vec->n++;
-}
-
 static void entryvec_free(EntryVec *vec) {
     for (size_t i = 0; i < vec->n; ++i) {
         free(vec->data[i].name);
         free(vec->data[i].anchor);
         free(vec->data[i].kind);
+        free(vec->data[i].decl);
+        free(vec->data[i].path);
     }
     free(vec->data);
     vec->data = NULL;
     vec->n = vec->cap = 0;
 }
 
-static const char *entryvec_lookup_anchor(const EntryVec *vec, const char *name, size_t len) {
-    if (!vec || !name) return NULL;
-    for (size_t i = 0; i < vec->n; ++i) {
-        Entry *e = &vec->data[i];
-        if (!e->name) continue;
-        size_t elen = strlen(e->name);
-        if (elen == len && strncmp(e->name, name, len) == 0) {
-            return e->anchor;
-        }
-    }
-    return NULL;
-}
-
+/* The anchor lives in the TU arena. */
 static char *make_anchor(const char *prefix, const char *name) {
     size_t plen = strlen(prefix);
     size_t nlen = strlen(name);
-    size_t cap = plen + nlen * 2 + 4;
-    char *buf = (char*)malloc(cap);
+    // prefix, one dash, at most one byte per name byte, NUL
+    char *buf = (char*)arena_alloc(&t_arena, plen + nlen + 2);
     size_t pos = 0;
     for (size_t i = 0; i < plen; ++i) {
         buf[pos++] = (char)tolower((unsigned char)prefix[i]);
@@ -477,10 +830,6 @@ static char *make_anchor(const char *prefix, const char *name) {
                 last_dash = true;
             }
         }
-        if (pos + 2 >= cap) {
-            cap *= 2;
-            buf = (char*)realloc(buf, cap);
-        }
     }
     while (pos > 0 && buf[pos - 1] == '-') pos--;
     if (pos == 0) {
@@ -490,21 +839,35 @@ static char *make_anchor(const char *prefix, const char *name) {
     return buf;
 }
 
-static void print_summary_section(const char *title, EntryVec *vec, bool include_kind) {
-    printf("## %s\n\n", title);
+/* --split DIR: g_shards[i] is the file input i is written to. A link to a
+ * symbol documented in another shard names that file; t_shard is the shard
+ * the calling thread is writing, -1 for the index. */
+static char **g_shards;
+static _Thread_local int t_shard = -1;
+
+static void sb_append_link_target(StrBuf *out, int file, const char *anchor) {
+    if (g_shards && file != t_shard) sb_append(out, g_shards[file]);
+    sb_append_char(out, '#');
+    sb_append(out, anchor);
+}
+
+static void print_summary_section(StrBuf *out, const char *title, EntryVec *vec, bool include_kind) {
+    sb_appendf(out, "## %s\n\n", title);
     if (vec->n == 0) {
-        printf("- (none)\n\n");
+        sb_append(out, "- (none)\n\n");
         return;
     }
     for (size_t i = 0; i < vec->n; ++i) {
         Entry *e = &vec->data[i];
         if (include_kind && e->kind) {
-            printf("- [%s `%s`](#%s)\n", e->kind, e->name, e->anchor);
+            sb_appendf(out, "- [%s `%s`](", e->kind, e->name);
         } else {
-            printf("- [`%s`](#%s)\n", e->name, e->anchor);
+            sb_appendf(out, "- [`%s`](", e->name);
         }
+        sb_append_link_target(out, e->file, e->anchor);
+        sb_append(out, ")\n");
     }
-    printf("\n");
+    sb_append(out, "\n");
 }
 
 static void set_add(StrSet *s, const char *key) {
@@ -512,10 +875,6 @@ static void set_add(StrSet *s, const char *key) {
     if (s->n == s->cap) { s->cap = s->cap ? s->cap * 2 : 64; s->data = (char**)realloc(s->data, s->cap * sizeof(char*)); }
     s->data[s->n++] = strdup(key);
 }
-static bool set_has(StrSet *s, const char *key) {
-    for (size_t i = 0; i < s->n; ++i) if (strcmp(s->data[i], key) == 0) return true;
-    return false;
-}
 static void set_free(StrSet *s) {
     for (size_t i = 0; i < s->n; ++i) free(s->data[i]);
     free(s->data);
@@ -523,108 +882,615 @@ static void set_free(StrSet *s) {
     s->n = s->cap = 0;
 }
 
-static const char *find_anchor_for_name(const char *name, size_t len) {
-    if (!name || len == 0) return NULL;
-    const char *anchor = entryvec_lookup_anchor(&g_functions, name, len);
-    if (anchor) return anchor;
-    anchor = entryvec_lookup_anchor(&g_types, name, len);
-    if (anchor) return anchor;
-    return entryvec_lookup_anchor(&g_macros, name, len);
+static uint64_t hash_str(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
 }
 
-static bool pattern_match(const char *pat, const char *text) {
-    if (!pat || !text) return false;
-    if (*pat == '\0') return *text == '\0';
-    if (*pat == '*') {
-        while (*pat == '*') pat++;
-        if (*pat == '\0') return true;
-        for (; *text; ++text) {
-            if (pattern_match(pat, text)) return true;
-        }
-        return pattern_match(pat, text);
+/* Open-addressing table of USRs. `owner` is the index of the earliest input
+ * that declared the symbol. */
+typedef struct {
+    char *key;
+    uint64_t hash;
+    int owner;
+} UsrSlot;
+
+typedef struct {
+    UsrSlot *slots;
+    size_t cap, n;
+} UsrTable;
+
+static UsrSlot *usrtable_probe(UsrTable *t, const char *key, uint64_t hash) {
+    size_t mask = t->cap - 1;
+    size_t i = (size_t)hash & mask;
+    for (;;) {
+        UsrSlot *slot = &t->slots[i];
+        if (!slot->key) return slot;
+        if (slot->hash == hash && strcmp(slot->key, key) == 0) return slot;
+        i = (i + 1) & mask;
     }
-    if (*pat == '?') {
-        if (*text == '\0') return false;
-        return pattern_match(pat + 1, text + 1);
+}
+
+static void usrtable_grow(UsrTable *t) {
+    size_t old_cap = t->cap;
+    UsrSlot *old = t->slots;
+    t->cap = old_cap ? old_cap * 2 : 256;
+    t->slots = (UsrSlot*)calloc(t->cap, sizeof(UsrSlot));
+    if (!t->slots) die("out of memory");
+    for (size_t i = 0; i < old_cap; ++i) {
+        if (!old[i].key) continue;
+        *usrtable_probe(t, old[i].key, old[i].hash) = old[i];
     }
-    if (*pat == *text) {
-        return pattern_match(pat + 1, text + 1);
+    free(old);
+}
+
+static UsrSlot *usrtable_insert(UsrTable *t, const char *key, uint64_t hash, bool *inserted) {
+    if ((t->n + 1) * 2 > t->cap) usrtable_grow(t);
+    UsrSlot *slot = usrtable_probe(t, key, hash);
+    *inserted = slot->key == NULL;
+    if (*inserted) {
+        slot->key = strdup(key);
+        if (!slot->key) die("out of memory");
+        slot->hash = hash;
+        t->n++;
     }
-    return false;
+    return slot;
 }
 
-static char *dup_cx(CXString s) {
-    const char *c = clang_getCString(s);
-    char *r = strdup(c ? c : "");
-    clang_disposeString(s);
-    return r;
+static UsrSlot *usrtable_find(UsrTable *t, const char *key, uint64_t hash) {
+    if (t->cap == 0) return NULL;
+    UsrSlot *slot = usrtable_probe(t, key, hash);
+    return slot->key ? slot : NULL;
 }
 
-static char *dup_range(const char *src, size_t len) {
-    char *out = (char*)malloc(len + 1);
-    if (!out) die("out of memory");
-    memcpy(out, src, len);
-    out[len] = '\0';
-    return out;
+static void usrtable_free(UsrTable *t) {
+    for (size_t i = 0; i < t->cap; ++i) free(t->slots[i].key);
+    free(t->slots);
+    t->slots = NULL;
+    t->cap = t->n = 0;
 }
 
-static bool should_ignore(const char *name) {
-    if (!name || !*name || g_ignore_patterns.n == 0) return false;
-    for (size_t i = 0; i < g_ignore_patterns.n; ++i) {
-        if (pattern_match(g_ignore_patterns.data[i], name)) return true;
+/* The run-wide USR registry, sharded so parallel workers rarely contend. A
+ * symbol belongs to the lowest-numbered input that declares it; later inputs
+ * skip it and earlier ones may take it over, so the merged document matches
+ * the serial order no matter how the workers interleave. */
+#define USR_SHARDS 64
+
+typedef struct {
+    UsrTable table;
+    pthread_mutex_t lock;
+} UsrShard;
+
+static UsrShard g_usr_registry[USR_SHARDS];
+
+static void usr_registry_init(void) {
+    for (int i = 0; i < USR_SHARDS; ++i) pthread_mutex_init(&g_usr_registry[i].lock, NULL);
+}
+
+static void usr_registry_free(void) {
+    for (int i = 0; i < USR_SHARDS; ++i) {
+        usrtable_free(&g_usr_registry[i].table);
+        pthread_mutex_destroy(&g_usr_registry[i].lock);
     }
-    return false;
 }
 
-static char *extract_macro_comment(CXTranslationUnit tu, CXCursor cursor) {
-    CXSourceRange range = clang_getCursorExtent(cursor);
-    CXSourceLocation start_loc = clang_getRangeStart(range);
-    CXFile file = NULL;
-    unsigned line = 0, col = 0;
-    unsigned offset = 0;
-    clang_getSpellingLocation(start_loc, &file, &line, &col, &offset);
-    if (!file) return NULL;
-    size_t buf_len = 0;
-    const char *buf = clang_getFileContents(tu, file, &buf_len);
-    if (!buf || offset == 0 || offset > buf_len) return NULL;
+static UsrShard *usr_shard(uint64_t hash) {
+    return &g_usr_registry[hash >> 58];
+}
 
-    size_t pos = offset;
-    while (pos > 0 && buf[pos - 1] != '\n') pos--;
-    // Skip whitespace between comment and macro; stop if blank line encountered
-    size_t idx = pos;
-    while (idx > 0 && isspace((unsigned char)buf[idx - 1])) {
-        if (buf[idx - 1] == '\n') {
-            size_t line_start = idx - 1;
-            while (line_start > 0 && buf[line_start - 1] != '\n') line_start--;
-            bool non_ws = false;
-            for (size_t i = line_start; i < idx - 1; ++i) {
-                if (!isspace((unsigned char)buf[i])) { non_ws = true; break; }
-            }
-            if (!non_ws) {
-                return NULL; // blank line separating comment
-            }
-        }
-        idx--;
+/* Records that `file` declares `usr` and returns the registry's copy of the
+ * key. `*owned` is set when `file` should document the symbol, i.e. neither
+ * this input nor an earlier one has claimed it yet. */
+static const char *usr_claim(const char *usr, uint64_t hash, int file, bool *owned) {
+    UsrShard *shard = usr_shard(hash);
+    pthread_mutex_lock(&shard->lock);
+    bool inserted = false;
+    UsrSlot *slot = usrtable_insert(&shard->table, usr, hash, &inserted);
+    *owned = inserted || slot->owner > file;
+    if (*owned) slot->owner = file;
+    const char *key = slot->key;
+    pthread_mutex_unlock(&shard->lock);
+    return key;
+}
+
+static int usr_owner(const char *usr, uint64_t hash) {
+    UsrShard *shard = usr_shard(hash);
+    pthread_mutex_lock(&shard->lock);
+    UsrSlot *slot = usrtable_find(&shard->table, usr, hash);
+    int owner = slot ? slot->owner : -1;
+    pthread_mutex_unlock(&shard->lock);
+    return owner;
+}
+
+/* Name -> anchor index used by the docstring linker. Built once after every
+ * input has been merged; lookups hash the word and compare lengths before
+ * bytes, so the cost depends on the word and not on the symbol count. */
+typedef struct {
+    const char *name;
+    size_t len;
+    uint64_t hash;
+    const char *anchor;
+    int file;
+} SymbolSlot;
+
+typedef struct {
+    SymbolSlot *slots;
+    size_t cap, n;
+} SymbolIndex;
+
+static SymbolIndex g_symbol_index;
+
+static SymbolSlot *symindex_probe(const SymbolIndex *idx, const char *name, size_t len, uint64_t hash) {
+    size_t mask = idx->cap - 1;
+    size_t i = (size_t)hash & mask;
+    for (;;) {
+        SymbolSlot *slot = &idx->slots[i];
+        if (!slot->name) return slot;
+        if (slot->hash == hash && slot->len == len && memcmp(slot->name, name, len) == 0) return slot;
+        i = (i + 1) & mask;
     }
-    if (idx == 0) return NULL;
-    size_t end = idx;
+}
 
-    // Attempt block comment detection
-    if (end >= 2 && buf[end - 2] == '*' && buf[end - 1] == '/') {
-        size_t start_pos = end - 2;
-        while (start_pos > 0) {
-            if (buf[start_pos - 1] == '/' && buf[start_pos] == '*') {
-                start_pos--;
-                break;
-            }
-            start_pos--;
-        }
-        if (buf[start_pos] != '/' || buf[start_pos + 1] != '*') return NULL;
-        size_t len = end - start_pos;
-        return dup_range(buf + start_pos, len);
+static void symindex_add_all(SymbolIndex *idx, const EntryVec *vec) {
+    for (size_t i = 0; i < vec->n; ++i) {
+        const Entry *e = &vec->data[i];
+        if (!e->name) continue;
+        size_t len = strlen(e->name);
+        uint64_t hash = hash_str(e->name, len);
+        SymbolSlot *slot = symindex_probe(idx, e->name, len, hash);
+        if (slot->name) continue; // earlier entries win, as with the old linear scan
+        slot->name = e->name;
+        slot->len = len;
+        slot->hash = hash;
+        slot->anchor = e->anchor;
+        slot->file = e->file;
+        idx->n++;
     }
+}
 
-    // Attempt line comment detection (// or ///) accumulating contiguous block
+static void symindex_free(SymbolIndex *idx) {
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->cap = idx->n = 0;
+}
+
+static void symindex_build(SymbolIndex *idx) {
+    symindex_free(idx);
+    size_t total = g_functions.n + g_types.n + g_macros.n;
+    idx->cap = 16;
+    while (idx->cap < total * 2) idx->cap *= 2;
+    idx->slots = (SymbolSlot*)calloc(idx->cap, sizeof(SymbolSlot));
+    if (!idx->slots) die("out of memory");
+    // Insertion order sets precedence: functions, then types, then macros.
+    symindex_add_all(idx, &g_functions);
+    symindex_add_all(idx, &g_types);
+    symindex_add_all(idx, &g_macros);
+}
+
+static const SymbolSlot *find_symbol(const char *name, size_t len) {
+    if (!name || len == 0 || g_symbol_index.n == 0) return NULL;
+    SymbolSlot *slot = symindex_probe(&g_symbol_index, name, len, hash_str(name, len));
+    return slot->name ? slot : NULL;
+}
+
+#define INDEX_MAGIC "DGIDX1\0\0"
+#define INDEX_RECORD_SIZE 40
+
+/* --link-index FILE=URL_PREFIX: another run's --emit-index PATH.idx,
+ * mapped read-only. Words this run does not define are looked up in each
+ * one in turn by binary search over its sorted records, and link to
+ * URL_PREFIX + page + "#" + anchor. */
+typedef struct {
+    const unsigned char *map;
+    size_t size;
+    uint32_t count;
+    const unsigned char *records;
+    const char *strings;
+    uint32_t strings_size;
+    const char *prefix;
+} LinkIndex;
+
+static LinkIndex *g_link_indexes;
+static size_t g_nlink_indexes;
+
+static uint32_t read_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Record field offsets; see emit_index for the layout. */
+enum { IDX_NAME = 0, IDX_KIND = 4, IDX_ANCHOR = 12, IDX_PAGE = 16 };
+
+static const char *link_index_string(const LinkIndex *li, const unsigned char *rec, size_t field) {
+    uint32_t off = read_le32(rec + field);
+    return off < li->strings_size ? li->strings + off : "";
+}
+
+/* `spec` is FILE=URL_PREFIX. */
+static void link_index_load(const char *spec) {
+    const char *eq = strchr(spec, '=');
+    if (!eq) die("--link-index expects FILE=URL_PREFIX");
+    char *path = dup_range(spec, (size_t)(eq - spec));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "error: cannot open --link-index file %s\n", path);
+        exit(1);
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = size >= 32 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    const unsigned char *p = map == MAP_FAILED ? NULL : (const unsigned char*)map;
+    bool ok = p && memcmp(p, INDEX_MAGIC, 8) == 0;
+    uint32_t count = ok ? read_le32(p + 8) : 0;
+    uint32_t strings_at = ok ? read_le32(p + 16) : 0;
+    uint32_t strings_size = ok ? read_le32(p + 20) : 0;
+    ok = ok && read_le32(p + 12) == INDEX_RECORD_SIZE && (uint64_t)count * INDEX_RECORD_SIZE + 32 <= strings_at &&
+         strings_size > 0 && (uint64_t)strings_at + strings_size <= size && p[strings_at + strings_size - 1] == '\0';
+    if (!ok) {
+        if (p) munmap(map, size);
+        fprintf(stderr, "error: %s is not a doc_gen symbol index\n", path);
+        exit(1);
+    }
+    free(path);
+    g_link_indexes = (LinkIndex*)realloc(g_link_indexes, (g_nlink_indexes + 1) * sizeof(LinkIndex));
+    if (!g_link_indexes) die("out of memory");
+    LinkIndex *li = &g_link_indexes[g_nlink_indexes++];
+    li->map = p;
+    li->size = size;
+    li->count = count;
+    li->records = p + 32;
+    li->strings = (const char*)p + strings_at;
+    li->strings_size = strings_size;
+    li->prefix = eq + 1;
+}
+
+static void link_indexes_free(void) {
+    for (size_t i = 0; i < g_nlink_indexes; ++i) munmap((void*)g_link_indexes[i].map, g_link_indexes[i].size);
+    free(g_link_indexes);
+    g_link_indexes = NULL;
+    g_nlink_indexes = 0;
+}
+
+/* Compare the NUL-terminated `s` with the word name[0, len). */
+static int word_cmp(const char *s, const char *name, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == '\0') return -1;
+        if (s[i] != name[i]) return (unsigned char)s[i] < (unsigned char)name[i] ? -1 : 1;
+    }
+    return s[len] == '\0' ? 0 : 1;
+}
+
+/* The record an external index has for `name`, preferring functions, then
+ * types, then macros as the local index does. */
+static const unsigned char *find_external_symbol(const char *name, size_t len, const LinkIndex **from) {
+    for (size_t k = 0; k < g_nlink_indexes; ++k) {
+        const LinkIndex *li = &g_link_indexes[k];
+        uint32_t lo = 0, hi = li->count;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (word_cmp(link_index_string(li, li->records + (size_t)mid * INDEX_RECORD_SIZE, IDX_NAME), name, len) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        const unsigned char *best = NULL;
+        for (uint32_t i = lo; i < li->count; ++i) {
+            const unsigned char *rec = li->records + (size_t)i * INDEX_RECORD_SIZE;
+            if (word_cmp(link_index_string(li, rec, IDX_NAME), name, len) != 0) break;
+            if (!best || read_le32(rec + IDX_KIND) > read_le32(best + IDX_KIND)) best = rec;
+        }
+        if (best) {
+            *from = li;
+            return best;
+        }
+    }
+    return NULL;
+}
+
+
+/* All --ignore patterns compiled into one matcher. Each pattern first goes
+ * through a literal prefilter: the text before its first wildcard, the text
+ * after its last one, and its minimum length. Patterns are bucketed by the
+ * first byte of that prefix so a name only looks at the handful that could
+ * apply. Patterns with at most one '*' and no '?' are decided by the
+ * prefilter alone; the rest run through a bit-parallel NFA where a pattern
+ * of length n owns n + 1 consecutive state bits (bit i means "the first i
+ * pattern characters have matched"). The NFA advances every surviving
+ * pattern at once in a single pass over the name, so matching is linear in
+ * the name length no matter how many '*' the patterns contain. The set keeps
+ * its own copy of the pattern text, so the StrSet it was compiled from may
+ * be freed right away. */
+typedef struct {
+    const char *prefix;
+    size_t prefix_len;
+    const char *suffix;
+    size_t suffix_len;
+    size_t min_len;
+    bool has_star;
+    bool literal_only; // prefilter decides; no NFA run needed
+    size_t first_state, last_state;
+} GlobPattern;
+
+typedef struct {
+    GlobPattern *patterns;
+    size_t npatterns;
+    char *text;              // the patterns, NUL-separated; prefix/suffix point here
+    size_t *bucket_items;    // pattern indices grouped by first prefix byte
+    size_t bucket_start[257]; // bucket c spans [bucket_start[c], bucket_start[c+1])
+    size_t *unanchored;      // patterns with an empty prefix
+    size_t nunanchored;
+    size_t words;            // 64-bit words per state vector
+    uint64_t *advance;       // [256 * words] states that step forward on byte c
+    uint64_t *star;          // states that loop on any byte (a '*')
+    uint64_t *accept;        // one final state per pattern
+} GlobSet;
+
+static GlobSet g_ignore;
+
+#define GLOB_STACK_WORDS 32
+
+static void glob_shift_in(uint64_t *dst, const uint64_t *src, size_t lo, size_t hi) {
+    uint64_t carry = 0;
+    for (size_t w = lo; w <= hi; ++w) {
+        uint64_t v = src[w];
+        dst[w] |= (v << 1) | carry;
+        carry = v >> 63;
+    }
+}
+
+/* Follow the epsilon edge out of every active '*' state. Runs of '*' are
+ * collapsed at compile time, so a single step reaches the closure. */
+static void glob_close(const GlobSet *g, uint64_t *state, uint64_t *tmp, size_t lo, size_t hi) {
+    for (size_t w = lo; w <= hi; ++w) tmp[w] = state[w] & g->star[w];
+    glob_shift_in(state, tmp, lo, hi);
+}
+
+static void glob_set_bit(uint64_t *vec, size_t bit) {
+    vec[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static void globset_compile(GlobSet *g, const StrSet *patterns) {
+    memset(g, 0, sizeof(*g));
+    if (patterns->n == 0) return;
+    g->npatterns = patterns->n;
+    g->patterns = (GlobPattern*)calloc(g->npatterns, sizeof(GlobPattern));
+    g->bucket_items = (size_t*)malloc(g->npatterns * sizeof(size_t));
+    g->unanchored = (size_t*)malloc(g->npatterns * sizeof(size_t));
+    if (!g->patterns || !g->bucket_items || !g->unanchored) die("out of memory");
+
+    size_t text_len = 0;
+    for (size_t i = 0; i < g->npatterns; ++i) text_len += strlen(patterns->data[i]) + 1;
+    g->text = (char*)malloc(text_len);
+    if (!g->text) die("out of memory");
+
+    size_t states = 0;
+    size_t counts[256] = {0};
+    char *copy = g->text;
+    for (size_t i = 0; i < g->npatterns; ++i) {
+        size_t len = strlen(patterns->data[i]);
+        const char *pat = memcpy(copy, patterns->data[i], len + 1);
+        copy += len + 1;
+        GlobPattern *gp = &g->patterns[i];
+        size_t stars = 0, questions = 0;
+        for (size_t k = 0; k < len; ++k) {
+            if (pat[k] == '*') stars++;
+            else if (pat[k] == '?') questions++;
+        }
+        gp->prefix = pat;
+        gp->prefix_len = strcspn(pat, "*?");
+        size_t tail = len;
+        while (tail > 0 && pat[tail - 1] != '*' && pat[tail - 1] != '?') tail--;
+        gp->suffix = pat + tail;
+        gp->suffix_len = len - tail;
+        gp->min_len = len - stars;
+        gp->has_star = stars > 0;
+        gp->literal_only = stars <= 1 && questions == 0;
+        // A literal pattern's prefix and suffix are the same text; only the
+        // prefix check is needed.
+        if (stars == 0 && questions == 0) gp->suffix_len = 0;
+        gp->first_state = states;
+        states += len + 1;
+        if (gp->prefix_len) counts[(unsigned char)pat[0]]++;
+        else g->unanchored[g->nunanchored++] = i;
+    }
+    size_t acc = 0;
+    for (int c = 0; c < 256; ++c) {
+        g->bucket_start[c] = acc;
+        acc += counts[c];
+    }
+    g->bucket_start[256] = acc;
+    size_t fill[256];
+    memcpy(fill, g->bucket_start, sizeof(fill));
+    for (size_t i = 0; i < g->npatterns; ++i) {
+        if (g->patterns[i].prefix_len) g->bucket_items[fill[(unsigned char)g->patterns[i].prefix[0]]++] = i;
+    }
+
+    g->words = (states + 63) / 64;
+    g->advance = (uint64_t*)calloc(256 * g->words, sizeof(uint64_t));
+    g->star = (uint64_t*)calloc(g->words, sizeof(uint64_t));
+    g->accept = (uint64_t*)calloc(g->words, sizeof(uint64_t));
+    if (!g->advance || !g->star || !g->accept) die("out of memory");
+    for (size_t i = 0; i < g->npatterns; ++i) {
+        GlobPattern *gp = &g->patterns[i];
+        const char *pat = patterns->data[i];
+        size_t pos = gp->first_state;
+        for (const char *p = pat; *p; ++p) {
+            if (*p == '*' && p > pat && p[-1] == '*') continue;
+            if (*p == '*') {
+                glob_set_bit(g->star, pos);
+            } else if (*p == '?') {
+                for (int c = 1; c < 256; ++c) glob_set_bit(g->advance + (size_t)c * g->words, pos);
+            } else {
+                glob_set_bit(g->advance + (size_t)(unsigned char)*p * g->words, pos);
+            }
+            pos++;
+        }
+        gp->last_state = pos;
+        glob_set_bit(g->accept, pos);
+    }
+}
+
+static void globset_free(GlobSet *g) {
+    free(g->patterns);
+    free(g->text);
+    free(g->bucket_items);
+    free(g->unanchored);
+    free(g->advance);
+    free(g->star);
+    free(g->accept);
+    memset(g, 0, sizeof(*g));
+}
+
+/* Prefilter one pattern. Returns 1 for a definite match, 0 for a definite
+ * miss and -1 when the NFA has to decide. */
+static int glob_prefilter(const GlobPattern *gp, const char *text, size_t len) {
+    if (len < gp->min_len) return 0;
+    if (!gp->has_star && len != gp->min_len) return 0;
+    if (gp->prefix_len && memcmp(text, gp->prefix, gp->prefix_len) != 0) return 0;
+    if (gp->suffix_len && memcmp(text + len - gp->suffix_len, gp->suffix, gp->suffix_len) != 0) return 0;
+    return gp->literal_only ? 1 : -1;
+}
+
+static bool globset_run_nfa(const GlobSet *g, const char *text, const size_t *cands, size_t ncands) {
+    size_t words = g->words;
+    uint64_t stack[3 * GLOB_STACK_WORDS];
+    uint64_t *mem = words <= GLOB_STACK_WORDS ? stack : (uint64_t*)malloc(3 * words * sizeof(uint64_t));
+    if (!mem) die("out of memory");
+    uint64_t *cur = mem, *next = mem + words, *tmp = mem + 2 * words;
+
+    // Only the words spanned by surviving patterns are ever touched.
+    size_t lo = SIZE_MAX, hi = 0;
+    for (size_t i = 0; i < ncands; ++i) {
+        const GlobPattern *gp = &g->patterns[cands[i]];
+        size_t a = gp->first_state / 64, b = gp->last_state / 64;
+        if (a < lo) lo = a;
+        if (b > hi) hi = b;
+    }
+    for (size_t w = lo; w <= hi; ++w) cur[w] = 0;
+    for (size_t i = 0; i < ncands; ++i) glob_set_bit(cur, g->patterns[cands[i]].first_state);
+    glob_close(g, cur, tmp, lo, hi);
+
+    bool alive = true;
+    for (const unsigned char *p = (const unsigned char*)text; *p && alive; ++p) {
+        const uint64_t *adv = g->advance + (size_t)*p * words;
+        uint64_t any = 0;
+        for (size_t w = lo; w <= hi; ++w) {
+            next[w] = cur[w] & g->star[w];
+            tmp[w] = cur[w] & adv[w];
+        }
+        glob_shift_in(next, tmp, lo, hi);
+        glob_close(g, next, tmp, lo, hi);
+        for (size_t w = lo; w <= hi; ++w) any |= next[w];
+        alive = any != 0;
+        uint64_t *swap = cur; cur = next; next = swap;
+    }
+    bool matched = false;
+    if (alive) {
+        for (size_t w = lo; w <= hi; ++w) {
+            if (cur[w] & g->accept[w]) { matched = true; break; }
+        }
+    }
+    if (mem != stack) free(mem);
+    return matched;
+}
+
+static bool globset_match(const GlobSet *g, const char *text) {
+    if (g->npatterns == 0 || !text) return false;
+    size_t len = strlen(text);
+    size_t stack_cands[64];
+    size_t *cands = g->npatterns <= 64 ? stack_cands : (size_t*)malloc(g->npatterns * sizeof(size_t));
+    if (!cands) die("out of memory");
+    size_t ncands = 0;
+    bool matched = false;
+
+    unsigned char first = (unsigned char)text[0];
+    for (size_t k = g->bucket_start[first]; k < g->bucket_start[first + 1] && !matched; ++k) {
+        int r = glob_prefilter(&g->patterns[g->bucket_items[k]], text, len);
+        if (r > 0) matched = true;
+        else if (r < 0) cands[ncands++] = g->bucket_items[k];
+    }
+    for (size_t k = 0; k < g->nunanchored && !matched; ++k) {
+        int r = glob_prefilter(&g->patterns[g->unanchored[k]], text, len);
+        if (r > 0) matched = true;
+        else if (r < 0) cands[ncands++] = g->unanchored[k];
+    }
+    if (!matched && ncands) matched = globset_run_nfa(g, text, cands, ncands);
+    if (cands != stack_cands) free(cands);
+    return matched;
+}
+
+/* Copy a CXString into the TU arena and dispose it. */
+static char *dup_cx(CXString s) {
+    const char *c = clang_getCString(s);
+    char *r = arena_dup(&t_arena, c ? c : "", c ? strlen(c) : 0);
+    clang_disposeString(s);
+    return r;
+}
+
+static char *dup_range(const char *src, size_t len) {
+    char *out = (char*)malloc(len + 1);
+    if (!out) die("out of memory");
+    memcpy(out, src, len);
+    out[len] = '\0';
+    return out;
+}
+
+static bool should_ignore(const char *name) {
+    if (!name || !*name) return false;
+    return globset_match(&g_ignore, name);
+}
+
+static char *extract_macro_comment(CXTranslationUnit tu, CXCursor cursor) {
+    CXSourceRange range = clang_getCursorExtent(cursor);
+    CXSourceLocation start_loc = clang_getRangeStart(range);
+    CXFile file = NULL;
+    unsigned line = 0, col = 0;
+    unsigned offset = 0;
+    clang_getSpellingLocation(start_loc, &file, &line, &col, &offset);
+    if (!file) return NULL;
+    size_t buf_len = 0;
+    const char *buf = clang_getFileContents(tu, file, &buf_len);
+    if (!buf || offset == 0 || offset > buf_len) return NULL;
+
+    size_t pos = offset;
+    while (pos > 0 && buf[pos - 1] != '\n') pos--;
+    // Skip whitespace between comment and macro; stop if blank line encountered
+    size_t idx = pos;
+    while (idx > 0 && isspace((unsigned char)buf[idx - 1])) {
+        if (buf[idx - 1] == '\n') {
+            size_t line_start = idx - 1;
+            while (line_start > 0 && buf[line_start - 1] != '\n') line_start--;
+            bool non_ws = false;
+            for (size_t i = line_start; i < idx - 1; ++i) {
+                if (!isspace((unsigned char)buf[i])) { non_ws = true; break; }
+            }
+            if (!non_ws) {
+                return NULL; // blank line separating comment
+            }
+        }
+        idx--;
+    }
+    if (idx == 0) return NULL;
+    size_t end = idx;
+
+    // Attempt block comment detection
+    if (end >= 2 && buf[end - 2] == '*' && buf[end - 1] == '/') {
+        size_t start_pos = end - 2;
+        while (start_pos > 0) {
+            if (buf[start_pos - 1] == '/' && buf[start_pos] == '*') {
+                start_pos--;
+                break;
+            }
+            start_pos--;
+        }
+        if (buf[start_pos] != '/' || buf[start_pos + 1] != '*') return NULL;
+        size_t len = end - start_pos;
+        return dup_range(buf + start_pos, len);
+    }
+
+    // Attempt line comment detection (// or ///) accumulating contiguous block
     size_t comment_start = end;
     size_t cur = end;
     bool saw_comment = false;
@@ -658,6 +1524,7 @@ static char *normalize_comment(const char *raw) {
     bool is_block = raw_len >= 2 && raw[0] == '/' && raw[1] == '*';
     bool is_line = raw_len >= 2 && raw[0] == '/' && raw[1] == '/';
     if (!is_block && !is_line) return dup_range(raw, raw_len);
+    Phase outer = stats_enter(PHASE_NORMALIZE);
 
     const char *p = raw;
     const char *end = raw + raw_len;
@@ -667,9 +1534,12 @@ static char *normalize_comment(const char *raw) {
         if (p < end && *p == ' ') p++;
     }
 
-    char **lines = NULL;
-    size_t *lens = NULL;
-    size_t n = 0, cap = 0;
+    // Stripped lines go straight into one scratch buffer; the output is
+    // never longer than the comment. Blank lines are only written once a
+    // later non-blank line shows they are not leading or trailing.
+    char *result = (char*)arena_alloc(&t_arena, raw_len + 1);
+    size_t pos = 0;
+    size_t blank_run = 0;
 
     while (p < end) {
         const char *line_end = memchr(p, '\n', end - p);
@@ -707,59 +1577,30 @@ static char *normalize_comment(const char *raw) {
             seg = 0;
         }
 
-        if (cap == n) {
-            cap = cap ? cap * 2 : 8;
-            lines = (char**)realloc(lines, cap * sizeof(char*));
-            lens = (size_t*)realloc(lens, cap * sizeof(size_t));
-            if (!lines || !lens) die("out of memory");
+        if (seg == 0) {
+            if (pos > 0) blank_run++;
+        } else {
+            if (pos > 0) {
+                for (size_t i = 0; i <= blank_run; ++i) result[pos++] = '\n';
+            }
+            blank_run = 0;
+            memcpy(result + pos, s, seg);
+            pos += seg;
         }
-        lines[n] = (seg > 0) ? dup_range(s, seg) : strdup("");
-        lens[n] = seg;
-        n++;
 
         if (!has_newline) break;
         p = line_end + 1;
     }
 
-    size_t start_idx = 0;
-    while (start_idx < n && lens[start_idx] == 0) start_idx++;
-    size_t end_idx = n;
-    while (end_idx > start_idx && lens[end_idx - 1] == 0) end_idx--;
-
-    if (start_idx == end_idx) {
-        for (size_t i = 0; i < n; ++i) free(lines[i]);
-        free(lines);
-        free(lens);
-        return NULL;
-    }
-    for (size_t i = 0; i < start_idx; ++i) free(lines[i]);
-    for (size_t i = end_idx; i < n; ++i) free(lines[i]);
-
-    size_t total = 0;
-    for (size_t i = start_idx; i < end_idx; ++i) {
-        total += lens[i];
-        if (i + 1 < end_idx) total++;
-    }
-    char *result = (char*)malloc(total + 1);
-    if (!result) die("out of memory");
-    size_t pos = 0;
-    for (size_t i = start_idx; i < end_idx; ++i) {
-        if (i > start_idx) result[pos++] = '\n';
-        if (lens[i] > 0) {
-            memcpy(result + pos, lines[i], lens[i]);
-            pos += lens[i];
-        }
-        free(lines[i]);
-    }
-    result[pos] = '\0';
-    free(lines);
-    free(lens);
-    char *md = doxygen_to_markdown(result);
-    free(result);
+    stats_enter(PHASE_DOXYGEN);
+    char *md = pos ? doxygen_to_markdown(result, pos) : NULL;
+    stats_leave(outer);
     return md;
 }
 
-static char *extract_file_doc(const char *path) {
+/* Read a whole file into a NUL-terminated heap buffer. Empty or unreadable
+ * files return NULL. */
+static char *read_file(const char *path, size_t *out_len) {
     FILE *fp = fopen(path, "rb");
     if (!fp) return NULL;
     if (fseek(fp, 0, SEEK_END) != 0) { fclose(fp); return NULL; }
@@ -773,6 +1614,13 @@ static char *extract_file_doc(const char *path) {
     fclose(fp);
     if (readn != len) { free(buf); return NULL; }
     buf[len] = '\0';
+    *out_len = len;
+    return buf;
+}
+
+/* The leading comment of an input, normalised, from its in-memory contents. */
+static char *extract_file_doc(const char *buf, size_t len) {
+    if (!buf) return NULL;
 
     size_t pos = 0;
     if (len >= 3 && (unsigned char)buf[0] == 0xEF && (unsigned char)buf[1] == 0xBB && (unsigned char)buf[2] == 0xBF)
@@ -780,14 +1628,14 @@ static char *extract_file_doc(const char *path) {
 
     while (pos < len && (buf[pos] == ' ' || buf[pos] == '\t' || buf[pos] == '\r' || buf[pos] == '\n'))
         pos++;
-    if (pos >= len) { free(buf); return NULL; }
+    if (pos >= len) return NULL;
 
     char *raw = NULL;
     if (buf[pos] == '/' && pos + 1 < len) {
         if (buf[pos + 1] == '*') {
             size_t cur = pos + 2;
             while (cur + 1 < len && !(buf[cur] == '*' && buf[cur + 1] == '/')) cur++;
-            if (cur + 1 >= len) { free(buf); return NULL; }
+            if (cur + 1 >= len) return NULL;
             cur += 2;
             raw = dup_range(buf + pos, cur - pos);
         } else if (buf[pos + 1] == '/') {
@@ -814,18 +1662,30 @@ static char *extract_file_doc(const char *path) {
         }
     }
 
-    free(buf);
     if (!raw) return NULL;
     char *md = normalize_comment(raw);
     free(raw);
     return md;
 }
 
-static void write_docstring_block(const char *md) {
+static void docspans_add(DocSpanVec *vec, size_t off, size_t len) {
+    if (vec->n == vec->cap) {
+        vec->cap = vec->cap ? vec->cap * 2 : 64;
+        vec->data = (DocSpan*)realloc(vec->data, vec->cap * sizeof(DocSpan));
+        if (!vec->data) die("out of memory");
+    }
+    vec->data[vec->n].off = off;
+    vec->data[vec->n].len = len;
+    vec->n++;
+}
+
+static void write_docstring_block(FileResult *res, const char *md) {
     if (!md || !*md) return;
-    fprintf(g_out, "%s\n", DOCSTRING_START);
-    fprintf(g_out, "%s\n", md);
-    fprintf(g_out, "%s\n\n", DOCSTRING_END);
+    size_t len = strlen(md);
+    while (len > 0 && (md[len - 1] == '\n' || md[len - 1] == '\r')) len--;
+    docspans_add(&res->docs, res->out.len, len);
+    sb_append_n(&res->out, md, len);
+    sb_append(&res->out, "\n\n");
 }
 
 static char *bump_markdown_headers(const char *text) {
@@ -877,16 +1737,16 @@ static bool is_word_char(char c) {
     return (c == '_') || isalnum((unsigned char)c);
 }
 
-static char *link_docstring_segment(const char *text) {
-    if (!text) return NULL;
-    if (*text == '\0') return dup_range("", 0);
-    StrBuf out = {0};
+/* Append `text` to `out`, linking every word that names a documented symbol.
+ * Fenced code blocks and inline code are copied verbatim. */
+static void link_docstring_segment(StrBuf *out, const char *text, size_t len) {
     const char *line_ptr = text;
+    const char *text_end = text + len;
     bool in_code_block = false;
 
-    while (line_ptr && *line_ptr) {
-        const char *line_end = strchr(line_ptr, '\n');
-        size_t line_len = line_end ? (size_t)(line_end - line_ptr) : strlen(line_ptr);
+    while (line_ptr < text_end) {
+        const char *line_end = (const char*)memchr(line_ptr, '\n', (size_t)(text_end - line_ptr));
+        size_t line_len = line_end ? (size_t)(line_end - line_ptr) : (size_t)(text_end - line_ptr);
         const char *trim = line_ptr;
         while ((size_t)(trim - line_ptr) < line_len && (*trim == ' ' || *trim == '\t')) trim++;
         bool is_fence = (line_len - (size_t)(trim - line_ptr) >= 3 && strncmp(trim, "```", 3) == 0);
@@ -898,7 +1758,7 @@ static char *link_docstring_segment(const char *text) {
             while (i < line_len) {
                 char ch = line_ptr[i];
                 if (ch == '`') {
-                    sb_append_char(&out, ch);
+                    sb_append_char(out, ch);
                     in_inline_code = !in_inline_code;
                     i++;
                     continue;
@@ -907,27 +1767,41 @@ static char *link_docstring_segment(const char *text) {
                     size_t start = i;
                     while (i < line_len && is_word_char(line_ptr[i])) i++;
                     size_t word_len = i - start;
-                    const char *anchor = find_anchor_for_name(line_ptr + start, word_len);
-                    if (anchor) {
-                        sb_append_char(&out, '[');
-                        sb_append_n(&out, line_ptr + start, word_len);
-                        sb_append(&out, "](#");
-                        sb_append(&out, anchor);
-                        sb_append_char(&out, ')');
+                    const SymbolSlot *sym = find_symbol(line_ptr + start, word_len);
+                    const LinkIndex *ext_index = NULL;
+                    const unsigned char *ext = (!sym && g_nlink_indexes)
+                        ? find_external_symbol(line_ptr + start, word_len, &ext_index) : NULL;
+                    if (t_stats) {
+                        t_stats->link_lookups++;
+                        if (sym || ext) t_stats->link_hits++;
+                    }
+                    if (sym || ext) {
+                        sb_append_char(out, '[');
+                        sb_append_n(out, line_ptr + start, word_len);
+                        sb_append(out, "](");
+                        if (sym) {
+                            sb_append_link_target(out, sym->file, sym->anchor);
+                        } else {
+                            sb_append(out, ext_index->prefix);
+                            sb_append(out, link_index_string(ext_index, ext, IDX_PAGE));
+                            sb_append_char(out, '#');
+                            sb_append(out, link_index_string(ext_index, ext, IDX_ANCHOR));
+                        }
+                        sb_append_char(out, ')');
                         continue;
                     }
-                    sb_append_n(&out, line_ptr + start, word_len);
+                    sb_append_n(out, line_ptr + start, word_len);
                     continue;
                 }
-                sb_append_char(&out, ch);
+                sb_append_char(out, ch);
                 i++;
             }
         } else {
-            sb_append_n(&out, line_ptr, line_len);
+            sb_append_n(out, line_ptr, line_len);
         }
 
         if (line_end) {
-            sb_append_char(&out, '\n');
+            sb_append_char(out, '\n');
             line_ptr = line_end + 1;
         } else {
             break;
@@ -937,74 +1811,98 @@ static char *link_docstring_segment(const char *text) {
             in_code_block = !in_code_block;
         }
     }
+}
 
-    char *result = sb_detach(&out);
-    sb_free(&out);
-    return result;
+/* The working directory with a trailing '/', read once at start-up; empty
+ * if it cannot be read. */
+static char g_cwd[4096];
+static size_t g_cwd_len;
+
+static void read_cwd(void) {
+    if (!getcwd(g_cwd, sizeof(g_cwd) - 1)) return;
+    g_cwd_len = strlen(g_cwd);
+    if (g_cwd_len == 0 || g_cwd[g_cwd_len - 1] != '/') g_cwd[g_cwd_len++] = '/';
+    g_cwd[g_cwd_len] = '\0';
 }
 
-static char *apply_docstring_links(const char *input) {
-    if (!input) return NULL;
-    const char *start_tag = DOCSTRING_START;
-    const char *end_tag = DOCSTRING_END;
-    size_t start_len = strlen(start_tag);
-    size_t end_len = strlen(end_tag);
+/* `path` made absolute against g_cwd (not folded). */
+static void absolute_path(const char *path, char *out, size_t cap) {
+    if (path[0] == '/' || !g_cwd_len) snprintf(out, cap, "%s", path);
+    else snprintf(out, cap, "%s%s", g_cwd, path);
+}
 
-    StrBuf out = {0};
-    const char *cursor = input;
-    while (cursor && *cursor) {
-        const char *start = strstr(cursor, start_tag);
-        if (!start) {
-            sb_append(&out, cursor);
-            break;
-        }
-        sb_append_n(&out, cursor, (size_t)(start - cursor));
-        const char *segment = start + start_len;
-        if (*segment == '\r') segment++;
-        if (*segment == '\n') segment++;
-        const char *end = strstr(segment, end_tag);
-        if (!end) {
-            sb_append(&out, start);
-            break;
-        }
-        const char *segment_end = end;
-        while (segment_end > segment && (segment_end[-1] == '\n' || segment_end[-1] == '\r')) {
-            segment_end--;
+/* A file path as shown to the reader: made absolute against the working
+ * directory, with "." and "dir/.." segments folded (lexically), and relative
+ * to the working directory when under it. A plain parse names a header as it
+ * was looked up (`./dep.h`) while a precompiled header or preamble records
+ * it by absolute path, so this is what keeps locations the same with --pch
+ * and --watch. Returns false if the result does not fit in `cap`. */
+static bool display_path(const char *path, char *out, size_t cap) {
+    char joined[4096];
+    if (path[0] != '/' && g_cwd_len) {
+        size_t plen = strlen(path);
+        if (g_cwd_len + plen + 1 > sizeof(joined)) return false;
+        memcpy(joined, g_cwd, g_cwd_len);
+        memcpy(joined + g_cwd_len, path, plen + 1);
+        path = joined;
+    }
+    size_t root = path[0] == '/' ? 1 : 0;
+    size_t len = root, depth = 0; // depth: segments a ".." may still fold
+    if (cap < 2) return false;
+    if (root) out[0] = '/';
+    for (const char *p = path + root; *p;) {
+        const char *end = strchr(p, '/');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        bool dotdot = n == 2 && p[0] == '.' && p[1] == '.';
+        if (dotdot && depth > 0) {
+            while (len > root && out[len - 1] != '/') --len;
+            if (len > root) --len;
+            --depth;
+        } else if (n > 0 && !(n == 1 && p[0] == '.') && !(dotdot && root)) {
+            if (len + n + 2 > cap) return false;
+            if (len > root) out[len++] = '/';
+            memcpy(out + len, p, n);
+            len += n;
+            if (!dotdot) ++depth;
         }
-        size_t seg_len = (size_t)(segment_end - segment);
-        char *raw_seg = dup_range(segment, seg_len);
-        char *linked = link_docstring_segment(raw_seg);
-        sb_append(&out, linked ? linked : raw_seg);
-        sb_append(&out, "\n\n");
-        free(linked);
-        free(raw_seg);
-
-        const char *after = end + end_len;
-        if (*after == '\r') after++;
-        if (*after == '\n') after++;
-        if (*after == '\r') after++;
-        if (*after == '\n') after++;
-        cursor = after;
+        p += n;
+        if (*p) ++p;
     }
-
-    return sb_detach(&out);
+    out[len] = '\0';
+    if (g_cwd_len && len > g_cwd_len && strncmp(out, g_cwd, g_cwd_len) == 0) {
+        memmove(out, out + g_cwd_len, len - g_cwd_len + 1);
+    } else if (g_cwd_len && len + 1 == g_cwd_len && strncmp(out, g_cwd, len) == 0) {
+        strcpy(out, "."); // the working directory itself
+    }
+    return true;
 }
 
-static void print_location(CXCursor c) {
+/* The file a cursor is spelled in, as shown to the reader, or NULL. The
+ * path lives in the TU arena. */
+static const char *cursor_location(CXCursor c, unsigned *line) {
     CXSourceLocation loc = clang_getCursorLocation(c);
-    CXFile file; unsigned line, col, off;
-    clang_getSpellingLocation(loc, &file, &line, &col, &off);
-    char *path = dup_cx(clang_getFileName(file));
-    if (path && *path) fprintf(g_out, "\n*Defined at*: `%s:%u`\n\n", path, line);
-    free(path);
+    CXFile file; unsigned col, off;
+    clang_getSpellingLocation(loc, &file, line, &col, &off);
+    CXString name = clang_getFileName(file);
+    const char *raw = clang_getCString(name);
+    char buf[4096];
+    const char *shown = raw && *raw && display_path(raw, buf, sizeof(buf)) ? buf : raw;
+    char *path = shown && *shown ? arena_dup(&t_arena, shown, strlen(shown)) : NULL;
+    clang_disposeString(name);
+    return path;
+}
+
+static void print_location(StrBuf *out, CXCursor c) {
+    unsigned line = 0;
+    const char *shown = cursor_location(c, &line);
+    if (shown) sb_appendf(out, "\n*Defined at*: `%s:%u`\n\n", shown, line);
 }
 
-static bool print_md_comment(CXCursor c) {
+static bool print_md_comment(FileResult *res, CXCursor c) {
     char *raw = dup_cx(clang_Cursor_getRawCommentText(c));
     char *norm = normalize_comment(raw);
-    free(raw);
     if (norm && *norm) {
-        write_docstring_block(norm);
+        write_docstring_block(res, norm);
         free(norm);
         return true;
     }
@@ -1012,8 +1910,8 @@ static bool print_md_comment(CXCursor c) {
     return false;
 }
 
-static void print_code_block(const char *code) {
-    fprintf(g_out, "```c\n%s\n```\n\n", code);
+static void print_code_block(StrBuf *out, const char *code) {
+    sb_appendf(out, "```c\n%s\n```\n\n", code);
 }
 
 static char *cursor_usr(CXCursor c) { return dup_cx(clang_getCursorUSR(c)); }
@@ -1021,29 +1919,188 @@ static char *cursor_name(CXCursor c) { return dup_cx(clang_getCursorSpelling(c))
 
 static char *type_spelling(CXType t) { return dup_cx(clang_getTypeSpelling(t)); }
 
+/* --only-main-file, --include-dir and --exclude-path decide per file
+ * whether its declarations are documented. */
+static bool g_only_main_file;
+static StrSet g_include_dirs, g_exclude_paths;
+static GlobSet g_include_globs, g_exclude_globs;
+static bool g_include_cwd; // --include-dir naming the working directory
+static bool g_scoped; // any of the three is set
+
+/* The decision for one file, keyed by its CXFile, which libclang hands out
+ * once per file in a TU. */
+typedef struct {
+    CXFile file;
+    bool used, in_scope;
+} ScopeSlot;
+
+typedef struct {
+    ScopeSlot *slots;
+    size_t cap, n;
+    CXFile last_file; // consecutive cursors mostly share a file
+    bool last_in_scope, has_last;
+} ScopeCache;
+
+static bool file_in_scope(CXSourceLocation loc, CXFile file) {
+    if (g_only_main_file && !clang_Location_isFromMainFile(loc)) return false;
+    if (!g_include_cwd && g_include_globs.npatterns == 0 && g_exclude_globs.npatterns == 0) return true;
+    // Matched as the path is shown, so the filters agree with "Defined at".
+    CXString name = clang_getFileName(file);
+    const char *raw = clang_getCString(name);
+    if (!raw) raw = "";
+    char buf[4096];
+    const char *shown = *raw && display_path(raw, buf, sizeof(buf)) ? buf : raw;
+    bool included = g_include_cwd ? (shown[0] && shown[0] != '/') || globset_match(&g_include_globs, shown)
+                  : g_include_globs.npatterns == 0 || globset_match(&g_include_globs, shown);
+    bool in_scope = included && !globset_match(&g_exclude_globs, shown);
+    clang_disposeString(name);
+    return in_scope;
+}
+
+static ScopeSlot *scope_probe(ScopeCache *sc, CXFile file) {
+    uint64_t h = (uint64_t)(uintptr_t)file * 0x9e3779b97f4a7c15ULL;
+    size_t mask = sc->cap - 1;
+    size_t i = (size_t)(h ^ (h >> 29)) & mask;
+    while (sc->slots[i].used && sc->slots[i].file != file) i = (i + 1) & mask;
+    return &sc->slots[i];
+}
+
+static void scope_grow(ScopeCache *sc) {
+    size_t old_cap = sc->cap;
+    ScopeSlot *old = sc->slots;
+    sc->cap = old_cap ? old_cap * 2 : 64;
+    sc->slots = (ScopeSlot*)calloc(sc->cap, sizeof(ScopeSlot));
+    if (!sc->slots) die("out of memory");
+    for (size_t i = 0; i < old_cap; ++i) {
+        if (old[i].used) *scope_probe(sc, old[i].file) = old[i];
+    }
+    free(old);
+}
+
+/* Add an --include-dir or --exclude-path argument, spelled the way
+ * display_path spells the files it is matched against, so `./inc/` and an
+ * absolute path under the working directory mean the same as `inc`. A
+ * directory matches every file below it. */
+static void scope_add_pattern(StrSet *set, const char *arg, bool dir) {
+    char buf[4096];
+    const char *pat = display_path(arg, buf, sizeof(buf)) ? buf : arg;
+    if (!dir) {
+        set_add(set, pat);
+        return;
+    }
+    StrBuf glob = {0};
+    size_t len = strlen(pat);
+    while (len > 1 && pat[len - 1] == '/') --len;
+    if (len == 1 && pat[0] == '.') {
+        // Everything shown relative, i.e. not by absolute path.
+        g_include_cwd = true;
+        return;
+    }
+    sb_appendf(&glob, "%.*s/*", (int)len, pat);
+    set_add(set, glob.buf);
+    sb_free(&glob);
+}
+
+/* Whether the file a cursor is expanded in passes the filters; the globs run
+ * at most once per file. */
+static bool cursor_in_scope(ScopeCache *sc, CXCursor c) {
+    CXSourceLocation loc = clang_getCursorLocation(c);
+    CXFile file; unsigned line, col, off;
+    clang_getExpansionLocation(loc, &file, &line, &col, &off);
+    if (sc->has_last && sc->last_file == file) return sc->last_in_scope;
+    if ((sc->n + 1) * 2 > sc->cap) scope_grow(sc);
+    ScopeSlot *slot = scope_probe(sc, file);
+    if (!slot->used) {
+        slot->file = file;
+        slot->used = true;
+        slot->in_scope = file_in_scope(loc, file);
+        sc->n++;
+    }
+    sc->last_file = file;
+    sc->last_in_scope = slot->in_scope;
+    sc->has_last = true;
+    return slot->in_scope;
+}
+
 typedef struct {
     CXTranslationUnit tu;
-    StrSet seen; // USR dedupe
+    FileResult *res;
+    const char *usr; // registry key of the cursor being emitted
+    uint64_t usr_hash;
+    // Set when the result must stand on its own (e.g. to be cached): every
+    // symbol is rendered and only repeats within this file are skipped.
+    UsrTable *local_seen;
+    ScopeCache scope;
 } Ctx;
 
-/* Join tokens in a source range into a single line of text (for macros/prototypes). */
+/* --emit-index PATH: also record each symbol's location and declaration. */
+static const char *g_emit_index;
+
+/* Start a new section at the current end of the file's buffer. Emitters call
+ * this right before writing the symbol's anchor. */
+static void section_open(Ctx *ctx, SectionKind kind, CXCursor c, const char *name, const char *anchor, const char *what) {
+    SectionVec *vec = &ctx->res->sections;
+    if (vec->n == vec->cap) {
+        vec->cap = vec->cap ? vec->cap * 2 : 64;
+        vec->data = (Section*)realloc(vec->data, vec->cap * sizeof(Section));
+        if (!vec->data) die("out of memory");
+    }
+    Section *sec = &vec->data[vec->n++];
+    sec->off = ctx->res->out.len;
+    sec->usr = ctx->usr;
+    sec->usr_hash = ctx->usr_hash;
+    sec->kind = kind;
+    sec->entry.name = strdup(name);
+    sec->entry.anchor = strdup(anchor);
+    sec->entry.kind = (what && *what) ? strdup(what) : NULL;
+    sec->entry.usr = NULL;
+    sec->entry.decl = NULL;
+    sec->entry.path = NULL;
+    sec->entry.line = 0;
+    if (g_emit_index) {
+        const char *path = cursor_location(c, &sec->entry.line);
+        if (path) sec->entry.path = strdup(path);
+        else sec->entry.line = 0;
+    }
+}
+
+/* The declaration recorded for --emit-index. */
+static void section_set_decl(Ctx *ctx, const char *prefix, const char *decl) {
+    if (!g_emit_index || !ctx->res->sections.n || !decl) return;
+    Entry *e = &ctx->res->sections.data[ctx->res->sections.n - 1].entry;
+    size_t plen = strlen(prefix), dlen = strlen(decl);
+    e->decl = (char*)malloc(plen + dlen + 1);
+    if (!e->decl) die("out of memory");
+    memcpy(e->decl, prefix, plen);
+    memcpy(e->decl + plen, decl, dlen + 1);
+}
+
+/* Join tokens in a source range into a single line of text (for macros/prototypes).
+ * The result lives in the TU arena. */
 static char *range_text(CXTranslationUnit tu, CXSourceRange range) {
     CXToken *toks = NULL; unsigned ntok = 0;
     clang_tokenize(tu, range, &toks, &ntok);
     size_t cap = 256, len = 0;
-    char *buf = (char*)malloc(cap);
+    char *buf = (char*)arena_alloc(&t_arena, cap);
     buf[0] = 0;
     for (unsigned i = 0; i < ntok; ++i) {
-        char *sp = dup_cx(clang_getTokenSpelling(tu, toks[i]));
+        CXString spelling = clang_getTokenSpelling(tu, toks[i]);
+        const char *sp = clang_getCString(spelling);
+        if (!sp) sp = "";
         size_t sl = strlen(sp);
-        if (len + sl + 2 >= cap) { cap = (len + sl + 2) * 2; buf = (char*)realloc(buf, cap); }
+        if (len + sl + 2 >= cap) {
+            cap = (len + sl + 2) * 2;
+            char *grown = (char*)arena_alloc(&t_arena, cap);
+            memcpy(grown, buf, len + 1);
+            buf = grown;
+        }
         if (len && sp[0] != ',' && sp[0] != ';' && sp[0] != ')' && sp[0] != ']' &&
             strcmp(sp, ">") && strcmp(sp, "::")) {
             // add space before most tokens except common punct
             buf[len++] = ' ';
         }
         memcpy(buf + len, sp, sl); len += sl; buf[len] = 0;
-        free(sp);
+        clang_disposeString(spelling);
     }
     clang_disposeTokens(tu, toks, ntok);
     // Collapse newlines/extra spaces
@@ -1051,23 +2108,85 @@ static char *range_text(CXTranslationUnit tu, CXSourceRange range) {
     return buf;
 }
 
+/* Copy source text into the TU arena as a single line: line continuations,
+ * comments and runs of whitespace become one space, literals are kept as
+ * written. The result is never longer than the input. */
+static char *collapse_source(const char *src, size_t len) {
+    char *out = (char*)arena_alloc(&t_arena, len + 1);
+    size_t o = 0, i = 0;
+    bool space = false;
+    while (i < len) {
+        char ch = src[i];
+        if (ch == '\\' && i + 1 < len && (src[i + 1] == '\n' || src[i + 1] == '\r')) {
+            i += (src[i + 1] == '\r' && i + 2 < len && src[i + 2] == '\n') ? 3 : 2;
+            space = true;
+            continue;
+        }
+        if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f' || ch == '\v') {
+            space = true;
+            i++;
+            continue;
+        }
+        if (ch == '/' && i + 1 < len && src[i + 1] == '*') {
+            i += 2;
+            while (i < len && !(src[i] == '*' && i + 1 < len && src[i + 1] == '/')) i++;
+            i = (i < len) ? i + 2 : len;
+            space = true;
+            continue;
+        }
+        if (ch == '/' && i + 1 < len && src[i + 1] == '/') {
+            // A continued line comment carries on onto the next line.
+            while (i < len && src[i] != '\n') i += (src[i] == '\\' && i + 1 < len) ? 2 : 1;
+            space = true;
+            continue;
+        }
+        if (space && o > 0) out[o++] = ' ';
+        space = false;
+        out[o++] = ch;
+        i++;
+        if (ch == '"' || ch == '\'') {
+            while (i < len && src[i] != ch && src[i] != '\n') {
+                if (src[i] == '\\' && i + 1 < len) out[o++] = src[i++];
+                out[o++] = src[i++];
+            }
+            if (i < len && src[i] == ch) out[o++] = src[i++];
+        }
+    }
+    out[o] = '\0';
+    return out;
+}
+
+/* The text of a macro definition ("NAME(args) body") sliced from the file
+ * buffer libclang already holds. NULL when the definition has no backing
+ * file, as for built-in macros. */
+static char *macro_source_text(CXTranslationUnit tu, CXCursor c) {
+    CXSourceRange r = clang_getCursorExtent(c);
+    CXFile file = NULL, end_file = NULL;
+    unsigned begin = 0, end = 0;
+    clang_getSpellingLocation(clang_getRangeStart(r), &file, NULL, NULL, &begin);
+    clang_getSpellingLocation(clang_getRangeEnd(r), &end_file, NULL, NULL, &end);
+    if (!file || !end_file || !clang_File_isEqual(file, end_file) || end < begin) return NULL;
+    size_t size = 0;
+    const char *buf = clang_getFileContents(tu, file, &size);
+    if (!buf || end > size) return NULL;
+    return collapse_source(buf + begin, end - begin);
+}
+
 /* Print function prototype */
-static void emit_function(CXCursor c) {
+static void emit_function(Ctx *ctx, CXCursor c) {
+    StrBuf *out = &ctx->res->out;
     char *name = cursor_name(c);
-    if (should_ignore(name)) {
-        free(name);
-        return;
-    }
+    if (should_ignore(name)) return;
     const char *anchor_key = (*name) ? name : "anonymous";
     char *anchor = make_anchor("function", anchor_key);
-    entryvec_add(&g_functions, anchor_key, anchor, NULL);
-    fprintf(g_out, "<a id=\"%s\"></a>\n", anchor);
+    section_open(ctx, SECTION_FUNCTION, c, anchor_key, anchor, NULL);
+    sb_appendf(out, "<a id=\"%s\"></a>\n", anchor);
     CXType ft = clang_getCursorType(c);
     CXType rt = clang_getResultType(ft);
     char *rts = type_spelling(rt);
     trim_trailing_space(rts);
-    fprintf(g_out, "### Function: `%s`\n\n", name);
-    print_md_comment(c);
+    sb_appendf(out, "### Function: `%s`\n\n", name);
+    print_md_comment(ctx->res, c);
     StrBuf proto = {0};
     int num_args = clang_Cursor_getNumArguments(c);
     bool variadic = clang_isFunctionTypeVariadic(ft);
@@ -1083,7 +2202,6 @@ static void emit_function(CXCursor c) {
             CXType arg_type = clang_getArgType(ft, (unsigned)i);
             char *arg_ts = type_spelling(arg_type);
             if ((!arg_ts || !*arg_ts) && !clang_equalTypes(arg_type, clang_getCursorType(arg_cursor))) {
-                free(arg_ts);
                 arg_ts = type_spelling(clang_getCursorType(arg_cursor));
             }
             trim_trailing_space(arg_ts);
@@ -1100,8 +2218,6 @@ static void emit_function(CXCursor c) {
                 }
                 sb_append(&proto, arg_name);
             }
-            free(arg_name);
-            free(arg_ts);
         }
         if (variadic) {
             if (num_args > 0) sb_append(&proto, ", ...");
@@ -1111,7 +2227,8 @@ static void emit_function(CXCursor c) {
     }
     if (proto.buf && proto.len > 0) {
         char *proto_line = sb_detach(&proto);
-        print_code_block(proto_line);
+        print_code_block(out, proto_line);
+        section_set_decl(ctx, "", proto_line);
         free(proto_line);
         sb_free(&proto);
     } else {
@@ -1119,66 +2236,59 @@ static void emit_function(CXCursor c) {
         char *disp = dup_cx(clang_getCursorDisplayName(c));
         char line[4096];
         snprintf(line, sizeof(line), "%s %s;", rts, disp);
-        print_code_block(line);
-        free(disp);
+        print_code_block(out, line);
+        section_set_decl(ctx, "", line);
     }
-    print_location(c);
-    fprintf(g_out, "---\n\n");
-    free(anchor);
-    free(name);
-    free(rts);
+    print_location(out, c);
+    sb_append(out, "---\n\n");
 }
 
 /* Collect struct/union fields or enum constants. */
 static enum CXChildVisitResult struct_enum_visitor(CXCursor c, CXCursor parent, CXClientData cd) {
+    StrBuf *out = (StrBuf*)cd;
     enum CXCursorKind k = clang_getCursorKind(c);
     if (k == CXCursor_FieldDecl) {
         char *nm = cursor_name(c);
         char *ts = type_spelling(clang_getCursorType(c));
-        fprintf(g_out, "- `%s %s;`\n", ts, nm);
-        free(nm); free(ts);
+        sb_appendf(out, "- `%s %s;`\n", ts, nm);
     } else if (k == CXCursor_EnumConstantDecl) {
         char *nm = cursor_name(c);
         long long val = clang_getEnumConstantDeclValue(c);
-        fprintf(g_out, "- `%s = %lld`\n", nm, val);
-        free(nm);
+        sb_appendf(out, "- `%s = %lld`\n", nm, val);
     }
     return CXChildVisit_Continue;
 }
 
-static void emit_record(CXCursor c, const char *what) {
+static void emit_record(Ctx *ctx, CXCursor c, const char *what) {
+    StrBuf *out = &ctx->res->out;
     char *name = cursor_name(c);
     const char *display = (*name) ? name : "(anonymous)";
-    if (should_ignore(display)) {
-        free(name);
-        return;
-    }
+    if (should_ignore(display)) return;
     char prefix[64];
     snprintf(prefix, sizeof(prefix), "type-%s", what);
     char *anchor = make_anchor(prefix, display);
-    entryvec_add(&g_types, display, anchor, what);
-    fprintf(g_out, "<a id=\"%s\"></a>\n", anchor);
-    fprintf(g_out, "### %s: `%s`\n\n", what, display);
-    print_md_comment(c);
+    section_open(ctx, SECTION_TYPE, c, display, anchor, what);
+    if (*name && !strchr(name, ' ')) {
+        enum CXCursorKind k = clang_getCursorKind(c);
+        section_set_decl(ctx, k == CXCursor_UnionDecl ? "union " : k == CXCursor_EnumDecl ? "enum " : "struct ", name);
+    }
+    sb_appendf(out, "<a id=\"%s\"></a>\n", anchor);
+    sb_appendf(out, "### %s: `%s`\n\n", what, display);
+    print_md_comment(ctx->res, c);
     // List members
-    clang_visitChildren(c, struct_enum_visitor, NULL);
-    fprintf(g_out, "\n");
-    print_location(c);
-    fprintf(g_out, "---\n\n");
-    free(anchor);
-    free(name);
+    clang_visitChildren(c, struct_enum_visitor, out);
+    sb_append(out, "\n");
+    print_location(out, c);
+    sb_append(out, "---\n\n");
 }
 
-static void emit_typedef(CXCursor c) {
+static void emit_typedef(Ctx *ctx, CXCursor c) {
+    StrBuf *out = &ctx->res->out;
     char *name = cursor_name(c);
     CXType ut = clang_getTypedefDeclUnderlyingType(c);
     char *uts = type_spelling(ut);
     const char *display = (*name) ? name : "(anonymous)";
-    if (should_ignore(display)) {
-        free(name);
-        free(uts);
-        return;
-    }
+    if (should_ignore(display)) return;
     bool skip_alias = false;
     CXCursor ut_decl = clang_getTypeDeclaration(ut);
     if (!clang_Cursor_isNull(ut_decl)) {
@@ -1188,133 +2298,1895 @@ static void emit_typedef(CXCursor c) {
             if (ut_name && *ut_name && name && strcmp(ut_name, name) == 0) {
                 skip_alias = true;
             }
-            free(ut_name);
         }
     }
-    if (skip_alias) {
-        free(name);
-        free(uts);
-        return;
-    }
+    if (skip_alias) return;
     char *anchor = make_anchor("type-typedef", display);
-    entryvec_add(&g_types, display, anchor, NULL);
-    fprintf(g_out, "<a id=\"%s\"></a>\n", anchor);
-    fprintf(g_out, "### Typedef: `%s`\n\n", name);
-    print_md_comment(c);
+    section_open(ctx, SECTION_TYPE, c, display, anchor, NULL);
+    sb_appendf(out, "<a id=\"%s\"></a>\n", anchor);
+    sb_appendf(out, "### Typedef: `%s`\n\n", name);
+    print_md_comment(ctx->res, c);
     char line[4096];
     snprintf(line, sizeof(line), "typedef %s %s;", uts, name);
-    print_code_block(line);
-    print_location(c);
-    fprintf(g_out, "---\n\n");
-    free(anchor);
-    free(name); free(uts);
+    print_code_block(out, line);
+    section_set_decl(ctx, "", line);
+    print_location(out, c);
+    sb_append(out, "---\n\n");
 }
 
-static void emit_macro(CXCursor c, CXTranslationUnit tu) {
+static void emit_macro(Ctx *ctx, CXCursor c) {
+    StrBuf *out = &ctx->res->out;
+    CXTranslationUnit tu = ctx->tu;
     char *name = cursor_name(c);
     const char *display = (*name) ? name : "(anonymous)";
-    if (should_ignore(display)) {
-        free(name);
-        return;
-    }
+    if (should_ignore(display)) return;
     char *anchor = make_anchor("macro", display);
-    entryvec_add(&g_macros, display, anchor, NULL);
-    fprintf(g_out, "<a id=\"%s\"></a>\n", anchor);
-    fprintf(g_out, "### Macro: `%s`\n\n", name);
+    section_open(ctx, SECTION_MACRO, c, display, anchor, NULL);
+    sb_appendf(out, "<a id=\"%s\"></a>\n", anchor);
+    sb_appendf(out, "### Macro: `%s`\n\n", name);
     // libclang rarely attaches raw comments to macros; still try:
-    if (!print_md_comment(c)) {
+    if (!print_md_comment(ctx->res, c)) {
         char *manual = extract_macro_comment(tu, c);
         char *norm = normalize_comment(manual);
         if (norm && *norm) {
-            write_docstring_block(norm);
+            write_docstring_block(ctx->res, norm);
         }
         free(norm);
         free(manual);
     }
-    // Reconstruct the #define line/body
-    CXSourceRange r = clang_getCursorExtent(c);
-    char *txt = range_text(tu, r);
-    // Ensure it includes "#define"; if not, synthesize.
-    if (strstr(txt, "#define") == NULL) {
-        char *def = (char*)malloc(strlen(name) + strlen(txt) + 16);
-        sprintf(def, "#define %s %s", name, txt);
-        free(txt); txt = def;
-    }
-    print_code_block(txt);
-    print_location(c);
-    fprintf(g_out, "---\n\n");
-    free(anchor);
-    free(txt); free(name);
+    // The extent covers the name, parameters and body, not the directive.
+    char *txt = macro_source_text(tu, c);
+    if (!txt) txt = range_text(tu, clang_getCursorExtent(c));
+    sb_appendf(out, "```c\n#define %s\n```\n\n", txt);
+    section_set_decl(ctx, "#define ", txt);
+    print_location(out, c);
+    sb_append(out, "---\n\n");
 }
 
-static enum CXChildVisitResult tu_visitor(CXCursor c, CXCursor parent, CXClientData client_data) {
-    Ctx *ctx = (Ctx*)client_data;
+static bool g_fast; // --fast: skip function bodies and prune the walk
+static bool g_watch; // --watch: keep every TU alive for reparsing
+
+/* Whether a documentable declaration can be nested inside a cursor of kind
+ * k. Records and typedefs can define records; function bodies are skipped
+ * in fast mode, and statements, expressions, enums and variables cannot. */
+static bool may_contain_decls(enum CXCursorKind k) {
+    switch (k) {
+        case CXCursor_StructDecl:
+        case CXCursor_UnionDecl:
+        case CXCursor_TypedefDecl:
+        case CXCursor_LinkageSpec:
+        case CXCursor_Namespace:
+        case CXCursor_UnexposedDecl:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static enum CXChildVisitResult tu_visitor(CXCursor c, CXCursor parent, CXClientData client_data) {
+    Ctx *ctx = (Ctx*)client_data;
     enum CXCursorKind k = clang_getCursorKind(c);
+    if (t_stats) t_stats->cursors++;
+    enum CXChildVisitResult next = CXChildVisit_Recurse;
+    if (g_fast && !may_contain_decls(k)) next = CXChildVisit_Continue;
+
+    // Out-of-scope files are cut at their top-level cursors, taking every
+    // nested declaration with them before any USR or name is computed.
+    // Expansions and includes have nothing to document or prune.
+    if (g_scoped && k != CXCursor_MacroExpansion && k != CXCursor_InclusionDirective
+        && clang_getCursorKind(parent) == CXCursor_TranslationUnit && !cursor_in_scope(&ctx->scope, c)) {
+        if (t_stats) t_stats->pruned++;
+        return CXChildVisit_Continue;
+    }
+
+    // Only kinds we document; parameters, fields and the like are not worth
+    // a USR lookup.
+    switch (k) {
+        case CXCursor_FunctionDecl:
+        case CXCursor_StructDecl:
+        case CXCursor_UnionDecl:
+        case CXCursor_EnumDecl:
+        case CXCursor_TypedefDecl:
+        case CXCursor_MacroDefinition:
+            break;
+        default:
+            return next;
+    }
+
+    // Dedup by USR when available (macros often lack USR). The registry is
+    // shared by every input, so symbols from a common header are documented
+    // once, under the first file that declares them.
+    char *usr = cursor_usr(c);
+    ctx->usr = NULL;
+    ctx->usr_hash = 0;
+    if (usr && *usr) {
+        uint64_t hash = hash_str(usr, strlen(usr));
+        bool owned = false;
+        const char *key = usr_claim(usr, hash, ctx->res->index, &owned);
+        bool skip = !owned;
+        if (ctx->local_seen) {
+            bool inserted = false;
+            usrtable_insert(ctx->local_seen, usr, hash, &inserted);
+            skip = !inserted;
+        }
+        if (skip) {
+            if (t_stats) t_stats->dedupe_hits++;
+            return CXChildVisit_Continue;
+        }
+        ctx->usr = key;
+        ctx->usr_hash = hash;
+    }
+
+    switch (k) {
+        case CXCursor_FunctionDecl:
+            // Emit the first declaration/definition we encounter; USR dedupe avoids repeats.
+            emit_function(ctx, c);
+            break;
+        case CXCursor_StructDecl: emit_record(ctx, c, ""); break;
+        case CXCursor_UnionDecl:  emit_record(ctx, c, "");  break;
+        case CXCursor_EnumDecl:   emit_record(ctx, c, "");   break;
+        case CXCursor_TypedefDecl: emit_typedef(ctx, c); break;
+        case CXCursor_MacroDefinition:
+            // Skip system headers, but allow project/local headers included by the file.
+            if (!cursor_is_in_system_header(c)) {
+                emit_macro(ctx, c);
+            }
+            break;
+        default: break;
+    }
+    return next;
+}
+
+/* 128-bit content digest: two independently seeded 64-bit lanes over 8-byte
+ * words. Used for the on-disk cache, so it favours throughput over being
+ * cryptographic. */
+typedef struct {
+    uint64_t a, b;
+} Digest;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static Digest digest_bytes(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t a = 0x243f6a8885a308d3ULL ^ len;
+    uint64_t b = 0x13198a2e03707344ULL ^ (len * 0x9e3779b97f4a7c15ULL);
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        a = (a ^ w) * 0x9e3779b97f4a7c15ULL;
+        a = (a << 31) | (a >> 33);
+        b = (b ^ w) * 0xc2b2ae3d27d4eb4fULL;
+        b = (b << 27) | (b >> 37);
+        p += 8;
+        len -= 8;
+    }
+    uint64_t w = 0;
+    memcpy(&w, p, len);
+    a = mix64(a ^ w);
+    b = mix64(b ^ w ^ 0xff);
+    Digest d = { a, b };
+    return d;
+}
+
+/* Folds a sequence of components into one digest. Each component is
+ * length-prefixed by construction, so ("ab","c") and ("a","bc") differ. */
+typedef struct {
+    Digest d;
+} Hasher;
+
+static void hasher_add(Hasher *h, const void *data, size_t len) {
+    Digest part = digest_bytes(data, len);
+    h->d.a = mix64(h->d.a ^ part.a) + 0x9e3779b97f4a7c15ULL;
+    h->d.b = mix64(h->d.b ^ part.b ^ h->d.a);
+}
+
+static void hasher_add_str(Hasher *h, const char *s) {
+    hasher_add(h, s ? s : "", s ? strlen(s) + 1 : 0);
+}
+
+static bool digest_equal(Digest x, Digest y) {
+    return x.a == y.a && x.b == y.b;
+}
+
+/* Persistent per-input cache. Each entry is named after a digest of the
+ * input's path, contents, clang arguments and output-affecting options, and
+ * stores the digests of every header the input included alongside the
+ * rendered FileResult. A hit requires every recorded header to still hash the
+ * same, so an unchanged input skips libclang entirely. */
+#define CACHE_MAGIC "DGC4"
+
+static const char *g_cache_dir;
+static Digest g_cache_salt; // clang args + options, shared by every input
+
+typedef struct {
+    char *key;
+    uint64_t hash;
+    Digest digest;
+    bool exists;
+} HeaderSlot;
+
+/* Headers shared by many inputs are hashed once per run. */
+static struct {
+    HeaderSlot *slots;
+    size_t cap, n;
+    pthread_mutex_t lock;
+} g_header_digests = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static HeaderSlot *header_slot_probe(const char *path, uint64_t hash) {
+    size_t mask = g_header_digests.cap - 1;
+    size_t i = (size_t)hash & mask;
+    for (;;) {
+        HeaderSlot *slot = &g_header_digests.slots[i];
+        if (!slot->key || (slot->hash == hash && strcmp(slot->key, path) == 0)) return slot;
+        i = (i + 1) & mask;
+    }
+}
+
+static bool header_digest(const char *path, Digest *out) {
+    uint64_t hash = hash_str(path, strlen(path));
+    pthread_mutex_lock(&g_header_digests.lock);
+    if (g_header_digests.cap) {
+        HeaderSlot *slot = header_slot_probe(path, hash);
+        if (slot->key) {
+            *out = slot->digest;
+            bool exists = slot->exists;
+            pthread_mutex_unlock(&g_header_digests.lock);
+            return exists;
+        }
+    }
+    pthread_mutex_unlock(&g_header_digests.lock);
+
+    size_t len = 0;
+    char *buf = read_file(path, &len);
+    Digest d = digest_bytes(buf ? buf : "", buf ? len : 0);
+    bool exists = buf != NULL || access(path, R_OK) == 0;
+    free(buf);
+
+    pthread_mutex_lock(&g_header_digests.lock);
+    if ((g_header_digests.n + 1) * 2 > g_header_digests.cap) {
+        HeaderSlot *old = g_header_digests.slots;
+        size_t old_cap = g_header_digests.cap;
+        g_header_digests.cap = old_cap ? old_cap * 2 : 256;
+        g_header_digests.slots = (HeaderSlot*)calloc(g_header_digests.cap, sizeof(HeaderSlot));
+        if (!g_header_digests.slots) die("out of memory");
+        for (size_t i = 0; i < old_cap; ++i) {
+            if (old[i].key) *header_slot_probe(old[i].key, old[i].hash) = old[i];
+        }
+        free(old);
+    }
+    HeaderSlot *slot = header_slot_probe(path, hash);
+    if (!slot->key) {
+        slot->key = strdup(path);
+        if (!slot->key) die("out of memory");
+        slot->hash = hash;
+        slot->digest = d;
+        slot->exists = exists;
+        g_header_digests.n++;
+    }
+    pthread_mutex_unlock(&g_header_digests.lock);
+    *out = d;
+    return exists;
+}
+
+static void header_digests_free(void) {
+    for (size_t i = 0; i < g_header_digests.cap; ++i) free(g_header_digests.slots[i].key);
+    free(g_header_digests.slots);
+    g_header_digests.slots = NULL;
+    g_header_digests.cap = g_header_digests.n = 0;
+}
+
+static void cache_entry_path(char *buf, size_t cap, Digest key) {
+    snprintf(buf, cap, "%s/%016llx%016llx", g_cache_dir,
+             (unsigned long long)key.a, (unsigned long long)key.b);
+}
+
+static bool g_pch_in_use;
+
+static Digest cache_key(const FileResult *res, const char *contents, size_t len) {
+    Hasher h = { g_cache_salt };
+    hasher_add_str(&h, res->path);
+    hasher_add(&h, contents, len);
+    if (res->args) {
+        hasher_add_str(&h, "--compdb");
+        for (int i = 0; i < res->nargs; ++i) hasher_add_str(&h, res->args[i]);
+    }
+    // Only the first input documents a precompiled prefix.
+    if (g_pch_in_use) hasher_add_str(&h, res->index == 0 ? "pch-owner" : "pch-user");
+    return h.d;
+}
+
+static void put_u32(StrBuf *sb, uint32_t v) { sb_append_n(sb, (const char*)&v, sizeof(v)); }
+static void put_u64(StrBuf *sb, uint64_t v) { sb_append_n(sb, (const char*)&v, sizeof(v)); }
+
+static void put_str(StrBuf *sb, const char *s) {
+    if (!s) { put_u32(sb, UINT32_MAX); return; }
+    uint32_t len = (uint32_t)strlen(s);
+    put_u32(sb, len);
+    sb_append_n(sb, s, len);
+}
+
+typedef struct {
+    const char *p, *end;
+    bool ok;
+} Reader;
+
+static bool get_bytes(Reader *r, void *dst, size_t n) {
+    if (!r->ok || (size_t)(r->end - r->p) < n) { r->ok = false; return false; }
+    memcpy(dst, r->p, n);
+    r->p += n;
+    return true;
+}
+
+static uint32_t get_u32(Reader *r) { uint32_t v = 0; get_bytes(r, &v, sizeof(v)); return v; }
+static uint64_t get_u64(Reader *r) { uint64_t v = 0; get_bytes(r, &v, sizeof(v)); return v; }
+
+/* Returns a heap copy, or NULL for a stored NULL or on a short read. */
+static char *get_str(Reader *r) {
+    uint32_t len = get_u32(r);
+    if (!r->ok || len == UINT32_MAX) return NULL;
+    if ((size_t)(r->end - r->p) < len) { r->ok = false; return NULL; }
+    char *s = dup_range(r->p, len);
+    r->p += len;
+    return s;
+}
+
+typedef struct {
+    StrBuf *sb;
+    CXTranslationUnit tu;
+    uint32_t count;
+} InclusionWriter;
+
+static void record_inclusion(CXFile file, CXSourceLocation *stack, unsigned depth, CXClientData data) {
+    InclusionWriter *w = (InclusionWriter*)data;
+    if (depth == 0) return; // the input itself is already part of the key
+    char *name = dup_cx(clang_getFileName(file));
+    size_t len = 0;
+    const char *contents = clang_getFileContents(w->tu, file, &len);
+    Digest d = digest_bytes(contents ? contents : "", contents ? len : 0);
+    put_str(w->sb, name);
+    put_u64(w->sb, d.a);
+    put_u64(w->sb, d.b);
+    w->count++;
+}
+
+static void cache_store(Digest key, const FileResult *res, CXTranslationUnit tu) {
+    StrBuf sb = {0};
+    sb_append_n(&sb, CACHE_MAGIC, 4);
+    size_t count_at = sb.len;
+    put_u32(&sb, 0);
+    InclusionWriter w = { &sb, tu, 0 };
+    clang_getInclusions(tu, record_inclusion, &w);
+    memcpy(sb.buf + count_at, &w.count, sizeof(w.count));
+
+    put_u64(&sb, res->out.len);
+    sb_append_n(&sb, res->out.buf, res->out.len);
+    put_u32(&sb, (uint32_t)res->sections.n);
+    for (size_t i = 0; i < res->sections.n; ++i) {
+        const Section *sec = &res->sections.data[i];
+        put_u64(&sb, sec->off);
+        put_u32(&sb, (uint32_t)sec->kind);
+        put_str(&sb, sec->usr);
+        put_str(&sb, sec->entry.name);
+        put_str(&sb, sec->entry.anchor);
+        put_str(&sb, sec->entry.kind);
+        put_str(&sb, sec->entry.decl);
+        put_str(&sb, sec->entry.path);
+        put_u32(&sb, sec->entry.line);
+    }
+    put_u32(&sb, (uint32_t)res->docs.n);
+    for (size_t i = 0; i < res->docs.n; ++i) {
+        put_u64(&sb, res->docs.data[i].off);
+        put_u64(&sb, res->docs.data[i].len);
+    }
+
+    // Write to a private name and rename so concurrent runs never observe a
+    // half-written entry.
+    char path[4096], tmp[4200];
+    cache_entry_path(path, sizeof(path), key);
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%d.tmp", path, (long)getpid(), res->index);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        bool ok = fwrite(sb.buf, 1, sb.len, fp) == sb.len;
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok || rename(tmp, path) != 0) remove(tmp);
+    }
+    sb_free(&sb);
+}
+
+static void free_sections(SectionVec *vec) {
+    for (size_t i = 0; i < vec->n; ++i) {
+        free(vec->data[i].entry.name);
+        free(vec->data[i].entry.anchor);
+        free(vec->data[i].entry.kind);
+        free(vec->data[i].entry.decl);
+        free(vec->data[i].entry.path);
+    }
+    free(vec->data);
+    vec->data = NULL;
+    vec->n = vec->cap = 0;
+}
+
+/* Fill `res` from a cache entry. Any mismatch or corruption is a miss and
+ * leaves `res` untouched. */
+static bool cache_load(Digest key, FileResult *res) {
+    char path[4096];
+    cache_entry_path(path, sizeof(path), key);
+    size_t len = 0;
+    char *buf = read_file(path, &len);
+    if (!buf) return false;
+    Reader r = { buf, buf + len, len >= 4 && memcmp(buf, CACHE_MAGIC, 4) == 0 };
+    if (r.ok) r.p += 4;
+
+    uint32_t nincludes = get_u32(&r);
+    for (uint32_t i = 0; i < nincludes && r.ok; ++i) {
+        char *header = get_str(&r);
+        Digest want;
+        want.a = get_u64(&r);
+        want.b = get_u64(&r);
+        Digest have;
+        if (!header || !header_digest(header, &have) || !digest_equal(want, have)) r.ok = false;
+        free(header);
+    }
+
+    uint64_t out_len = get_u64(&r);
+    StrBuf out = {0};
+    if (r.ok && (uint64_t)(r.end - r.p) >= out_len) {
+        sb_append_n(&out, r.p, (size_t)out_len);
+        r.p += out_len;
+    } else {
+        r.ok = false;
+    }
+    SectionVec sections = {0};
+    uint32_t nsections = get_u32(&r);
+    for (uint32_t i = 0; i < nsections && r.ok; ++i) {
+        Section sec = {0};
+        sec.off = (size_t)get_u64(&r);
+        sec.kind = (SectionKind)get_u32(&r);
+        char *usr = get_str(&r);
+        sec.entry.name = get_str(&r);
+        sec.entry.anchor = get_str(&r);
+        sec.entry.kind = get_str(&r);
+        sec.entry.decl = get_str(&r);
+        sec.entry.path = get_str(&r);
+        sec.entry.line = get_u32(&r);
+        if (!r.ok || !sec.entry.name || !sec.entry.anchor || sec.off > out.len) {
+            r.ok = false;
+        } else if (usr) {
+            bool owned = false;
+            sec.usr_hash = hash_str(usr, strlen(usr));
+            sec.usr = usr_claim(usr, sec.usr_hash, res->index, &owned);
+        }
+        free(usr);
+        if (sections.n == sections.cap) {
+            sections.cap = sections.cap ? sections.cap * 2 : 64;
+            sections.data = (Section*)realloc(sections.data, sections.cap * sizeof(Section));
+            if (!sections.data) die("out of memory");
+        }
+        sections.data[sections.n++] = sec;
+    }
+    DocSpanVec docs = {0};
+    uint32_t ndocs = get_u32(&r);
+    for (uint32_t i = 0; i < ndocs && r.ok; ++i) {
+        uint64_t off = get_u64(&r);
+        uint64_t dlen = get_u64(&r);
+        if (!r.ok || off > out.len || dlen > out.len - off) r.ok = false;
+        else docspans_add(&docs, (size_t)off, (size_t)dlen);
+    }
+    free(buf);
+    if (!r.ok) {
+        sb_free(&out);
+        free_sections(&sections);
+        free(docs.data);
+        return false;
+    }
+    res->out = out;
+    res->sections = sections;
+    res->docs = docs;
+    return true;
+}
+
+/* Render a parsed TU into res->out: the file header, its leading comment
+ * and every documented declaration. */
+static void visit_tu(FileResult *res, CXTranslationUnit tu, const char *file_doc) {
+    Ctx ctx = {0};
+    ctx.tu = tu;
+    ctx.res = res;
+    // Cached and watched results must not depend on which other inputs
+    // happened to claim a symbol first, so they only dedupe within the TU
+    // and leave ownership to the merge.
+    UsrTable local_seen = {0};
+    if (g_cache_dir || g_watch) ctx.local_seen = &local_seen;
+    sb_appendf(&res->out, "## File: %s\n\n", res->path);
+    if (file_doc) {
+        char *adjusted = bump_markdown_headers(file_doc);
+        const char *doc = adjusted ? adjusted : file_doc;
+        write_docstring_block(res, doc);
+        free(adjusted);
+    }
+    Phase outer = stats_enter(PHASE_VISIT);
+    uint64_t span = trace_begin();
+    clang_visitChildren(clang_getTranslationUnitCursor(tu), tu_visitor, &ctx);
+    trace_end("visit", span, res->path, "symbols", res->sections.n);
+    stats_leave(outer);
+    usrtable_free(&local_seen);
+    free(ctx.scope.slots);
+}
+
+static void watch_collect_deps(FileResult *res);
+
+static void process_file(CXIndex idx, FileResult *res, int clang_argc, const char **clang_argv) {
+    const char *path = res->path;
+    // The input is read once: the same bytes key the cache, supply the file
+    // doc and are handed to clang as an unsaved file so it does not go back
+    // to disk for them.
+    Phase outer = stats_enter(PHASE_FILE_DOC);
+    size_t contents_len = 0;
+    char *contents = read_file(path, &contents_len);
+    stats_leave(outer);
+    Digest key = {0, 0};
+    if (g_cache_dir) {
+        key = cache_key(res, contents ? contents : "", contents ? contents_len : 0);
+        if (cache_load(key, res)) {
+            free(contents);
+            return;
+        }
+    }
+    uint64_t parse_start = clock_ns(CLOCK_MONOTONIC);
+    outer = stats_enter(PHASE_FILE_DOC);
+    char *file_doc = extract_file_doc(contents, contents_len);
+    bool have_file_doc = file_doc && *file_doc;
+    stats_enter(PHASE_PARSE);
+    uint64_t span = trace_begin();
+    unsigned opts = CXTranslationUnit_DetailedPreprocessingRecord |
+                    CXTranslationUnit_IncludeBriefCommentsInCodeCompletion;
+    if (g_fast) opts |= CXTranslationUnit_SkipFunctionBodies;
+    // Watched inputs are reparsed on every save; a precompiled preamble lets
+    // an edit below the #includes skip them.
+    if (g_watch) opts |= CXTranslationUnit_PrecompiledPreamble | CXTranslationUnit_CreatePreambleOnFirstParse;
+    struct CXUnsavedFile unsaved = { path, contents, (unsigned long)contents_len };
+    CXTranslationUnit tu = NULL;
+    enum CXErrorCode ec = clang_parseTranslationUnit2(
+        idx, path, clang_argv, clang_argc, contents ? &unsaved : NULL, contents ? 1 : 0, opts, &tu);
+    // libclang keeps its own copy of unsaved files.
+    free(contents);
+    trace_end("parse", span, path, NULL, 0);
+    stats_leave(outer);
+    if (ec != CXError_Success || !tu) {
+        fprintf(stderr, "failed to parse: %s (ec=%d)\n", path, ec);
+        free(file_doc);
+        arena_reset(&t_arena);
+        return;
+    }
+    visit_tu(res, tu, have_file_doc ? file_doc : NULL);
+    free(file_doc);
+    res->parse_ns = clock_ns(CLOCK_MONOTONIC) - parse_start;
+    if (g_cache_dir) cache_store(key, res, tu);
+    if (g_watch) {
+        res->tu = tu;
+        watch_collect_deps(res);
+    } else {
+        clang_disposeTranslationUnit(tu);
+    }
+    arena_reset(&t_arena);
+}
+
+/* How long each input took to parse on earlier runs, kept in
+ * <cache-dir>/timings as "<ns> <path>" lines sorted by path. */
+typedef struct {
+    char *path;
+    uint64_t ns;
+} Timing;
+
+typedef struct {
+    Timing *data;
+    size_t n, cap;
+} TimingVec;
+
+static int timing_cmp(const void *a, const void *b) {
+    return strcmp(((const Timing*)a)->path, ((const Timing*)b)->path);
+}
+
+static void timings_push(TimingVec *vec, char *path, uint64_t ns) {
+    if (vec->n == vec->cap) {
+        vec->cap = vec->cap ? vec->cap * 2 : 64;
+        vec->data = (Timing*)realloc(vec->data, vec->cap * sizeof(Timing));
+        if (!vec->data) die("out of memory");
+    }
+    vec->data[vec->n].path = path;
+    vec->data[vec->n].ns = ns;
+    vec->n++;
+}
+
+static void timings_free(TimingVec *vec) {
+    for (size_t i = 0; i < vec->n; ++i) free(vec->data[i].path);
+    free(vec->data);
+    memset(vec, 0, sizeof(*vec));
+}
+
+static void timings_load(TimingVec *vec) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/timings", g_cache_dir);
+    size_t len = 0;
+    char *text = read_file(path, &len);
+    if (!text) return;
+    for (char *line = text; *line;) {
+        char *eol = strchr(line, '\n');
+        if (eol) *eol = '\0';
+        char *end = NULL;
+        unsigned long long ns = strtoull(line, &end, 10);
+        if (end != line && *end == ' ' && end[1]) timings_push(vec, strdup(end + 1), ns);
+        if (!eol) break;
+        line = eol + 1;
+    }
+    free(text);
+    qsort(vec->data, vec->n, sizeof(Timing), timing_cmp);
+}
+
+static const Timing *timings_find(const TimingVec *vec, const char *path) {
+    Timing key = { (char*)path, 0 };
+    return vec->n ? (const Timing*)bsearch(&key, vec->data, vec->n, sizeof(Timing), timing_cmp) : NULL;
+}
+
+/* Record this run's parse times. Inputs served from the cache keep their
+ * old entry, and entries for files not on this command line are kept. */
+static void timings_save(const FileResult *results, int nfiles) {
+    TimingVec old = {0}, merged = {0};
+    timings_load(&old);
+    for (int i = 0; i < nfiles; ++i) {
+        const Timing *prev = timings_find(&old, results[i].path);
+        uint64_t ns = results[i].parse_ns ? results[i].parse_ns : prev ? prev->ns : 0;
+        if (ns) timings_push(&merged, strdup(results[i].path), ns);
+    }
+    qsort(merged.data, merged.n, sizeof(Timing), timing_cmp);
+    size_t ncurrent = merged.n;
+    for (size_t i = 0; i < old.n; ++i) {
+        Timing key = { old.data[i].path, 0 };
+        if (ncurrent && bsearch(&key, merged.data, ncurrent, sizeof(Timing), timing_cmp)) continue;
+        timings_push(&merged, strdup(old.data[i].path), old.data[i].ns);
+    }
+    qsort(merged.data, merged.n, sizeof(Timing), timing_cmp);
+
+    char path[4096], tmp[4200];
+    snprintf(path, sizeof(path), "%s/timings", g_cache_dir);
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        bool ok = true;
+        for (size_t i = 0; i < merged.n && ok; ++i) {
+            ok = fprintf(fp, "%llu %s\n", (unsigned long long)merged.data[i].ns, merged.data[i].path) > 0;
+        }
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok || rename(tmp, path) != 0) remove(tmp);
+    }
+    timings_free(&old);
+    timings_free(&merged);
+}
+
+typedef struct {
+    uint64_t cost;
+    int index;
+} Scheduled;
+
+static int scheduled_cmp(const void *a, const void *b) {
+    const Scheduled *x = (const Scheduled*)a, *y = (const Scheduled*)b;
+    if (x->cost != y->cost) return x->cost > y->cost ? -1 : 1;
+    return x->index - y->index;
+}
+
+/* Fill `order` with the inputs most expensive first, so the slowest TUs are
+ * not left for the end of a parallel run. The cost is the previous run's
+ * parse time when --cache-dir has one, otherwise the file size scaled by
+ * the ns/byte of the files that do have a timing. */
+static void schedule_inputs(FileResult *results, int nfiles, int *order) {
+    TimingVec timings = {0};
+    if (g_cache_dir) timings_load(&timings);
+    Scheduled *sched = (Scheduled*)malloc((size_t)nfiles * sizeof(Scheduled));
+    bool *known = (bool*)calloc((size_t)nfiles, sizeof(bool));
+    if (!sched || !known) die("out of memory");
+    uint64_t known_ns = 0, known_bytes = 0;
+    for (int i = 0; i < nfiles; ++i) {
+        struct stat st;
+        uint64_t size = stat(results[i].path, &st) == 0 ? (uint64_t)st.st_size : 0;
+        const Timing *t = timings_find(&timings, results[i].path);
+        results[i].cost = t ? t->ns : size;
+        known[i] = t != NULL;
+        if (t) {
+            known_ns += t->ns;
+            known_bytes += size;
+        }
+    }
+    double ns_per_byte = (known_ns && known_bytes) ? (double)known_ns / (double)known_bytes : 0.0;
+    for (int i = 0; i < nfiles; ++i) {
+        if (!known[i] && ns_per_byte > 0) results[i].cost = (uint64_t)((double)results[i].cost * ns_per_byte);
+        sched[i].cost = results[i].cost;
+        sched[i].index = i;
+    }
+    qsort(sched, (size_t)nfiles, sizeof(Scheduled), scheduled_cmp);
+    for (int i = 0; i < nfiles; ++i) order[i] = sched[i].index;
+    free(sched);
+    free(known);
+    timings_free(&timings);
+}
+
+/* Inputs are handed out one at a time from a shared counter so a slow TU
+ * never holds up a worker that could be parsing the next file. */
+typedef struct {
+    FileResult *results;
+    int nfiles;
+    int clang_argc;
+    const char **clang_argv;
+    bool pch; // clang_argv carries -include-pch
+    const int *order; // inputs in the order to parse them
+    atomic_int next;
+} WorkQueue;
+
+/* Indexes are pooled for the life of the process rather than created per
+ * worker, so --manifest jobs after the first start with warm ones. The
+ * second kind is created with excludeDeclsFromPCH. Under --watch the
+ * indexes the live TUs were parsed with are held in `kept` until the TUs
+ * are disposed. */
+static struct {
+    CXIndex *data[2];
+    size_t n[2], cap[2];
+    CXIndex *kept[2];
+    size_t nkept[2], kept_cap[2];
+    pthread_mutex_t lock;
+} g_indexes = { { NULL, NULL }, { 0, 0 }, { 0, 0 }, { NULL, NULL }, { 0, 0 }, { 0, 0 }, PTHREAD_MUTEX_INITIALIZER };
+
+static void index_push(CXIndex **data, size_t *n, size_t *cap, CXIndex idx) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 8;
+        *data = (CXIndex*)realloc(*data, *cap * sizeof(CXIndex));
+        if (!*data) die("out of memory");
+    }
+    (*data)[(*n)++] = idx;
+}
+
+static CXIndex index_acquire(int exclude_pch) {
+    CXIndex idx = NULL;
+    pthread_mutex_lock(&g_indexes.lock);
+    if (g_indexes.n[exclude_pch] > 0) idx = g_indexes.data[exclude_pch][--g_indexes.n[exclude_pch]];
+    pthread_mutex_unlock(&g_indexes.lock);
+    return idx ? idx : clang_createIndex(exclude_pch, /*displayDiagnostics=*/0);
+}
+
+static void index_release(CXIndex idx, int exclude_pch) {
+    pthread_mutex_lock(&g_indexes.lock);
+    index_push(&g_indexes.data[exclude_pch], &g_indexes.n[exclude_pch], &g_indexes.cap[exclude_pch], idx);
+    pthread_mutex_unlock(&g_indexes.lock);
+}
+
+/* Hold an index while watched TUs built with it are alive. */
+static void index_keep(CXIndex idx, int exclude_pch) {
+    pthread_mutex_lock(&g_indexes.lock);
+    index_push(&g_indexes.kept[exclude_pch], &g_indexes.nkept[exclude_pch], &g_indexes.kept_cap[exclude_pch], idx);
+    pthread_mutex_unlock(&g_indexes.lock);
+}
+
+/* Return the kept indexes to the pool once their TUs are disposed. */
+static void index_release_kept(void) {
+    for (int k = 0; k < 2; ++k) {
+        for (size_t i = 0; i < g_indexes.nkept[k]; ++i) index_release(g_indexes.kept[k][i], k);
+        free(g_indexes.kept[k]);
+        g_indexes.kept[k] = NULL;
+        g_indexes.nkept[k] = g_indexes.kept_cap[k] = 0;
+    }
+}
+
+static void index_pool_free(void) {
+    for (int k = 0; k < 2; ++k) {
+        for (size_t i = 0; i < g_indexes.n[k]; ++i) clang_disposeIndex(g_indexes.data[k][i]);
+        free(g_indexes.data[k]);
+        g_indexes.data[k] = NULL;
+        g_indexes.n[k] = g_indexes.cap[k] = 0;
+    }
+}
+
+static void *parse_worker(void *arg) {
+    WorkQueue *q = (WorkQueue*)arg;
+    // libclang is safe to drive from several threads as long as each one
+    // owns its own index.
+    CXIndex idx = index_acquire(/*excludeDeclsFromPCH=*/0);
+    // Every input sees the precompiled prefix, and its symbols belong to the
+    // first input anyway, so the others skip visiting it altogether.
+    CXIndex local_idx = NULL;
+    for (;;) {
+        int slot = atomic_fetch_add(&q->next, 1);
+        if (slot >= q->nfiles) break;
+        int i = q->order[slot];
+        FileResult *res = &q->results[i];
+        CXIndex use = idx;
+        if (q->pch && i > 0) {
+            if (!local_idx) local_idx = index_acquire(/*excludeDeclsFromPCH=*/1);
+            use = local_idx;
+        }
+        t_stats = g_stats ? &res->stats : NULL;
+        uint64_t span = trace_begin();
+        if (res->args) process_file(use, res, res->nargs, (const char**)res->args);
+        else process_file(use, res, q->clang_argc, q->clang_argv);
+        trace_end("process_file", span, res->path, "symbols", res->sections.n);
+        t_stats = NULL;
+    }
+    // Watched TUs outlive the workers and need their index until run_job
+    // disposes them.
+    if (g_watch) {
+        if (local_idx) index_keep(local_idx, 1);
+        index_keep(idx, 0);
+    } else {
+        if (local_idx) index_release(local_idx, 1);
+        index_release(idx, 0);
+    }
+    arena_free(&t_arena);
+    return NULL;
+}
+
+static void run_workers(WorkQueue *q, int jobs) {
+    if (jobs > q->nfiles) jobs = q->nfiles;
+    if (jobs <= 1) {
+        parse_worker(q);
+        return;
+    }
+    pthread_t *threads = (pthread_t*)malloc((size_t)jobs * sizeof(pthread_t));
+    if (!threads) die("out of memory");
+    // With --stats libclang parses on our threads rather than its own (see
+    // main); give them the 8 MiB stack its thread would have had.
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (g_stats) pthread_attr_setstacksize(&attr, (size_t)8 << 20);
+    int started = 0;
+    for (; started < jobs; ++started) {
+        if (pthread_create(&threads[started], &attr, parse_worker, q) != 0) break;
+    }
+    pthread_attr_destroy(&attr);
+    // If the system refused to give us more threads, the ones we have will
+    // simply drain the queue; with none at all we do the work ourselves.
+    if (started == 0) parse_worker(q);
+    for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+static void entryvec_push(EntryVec *vec, Entry e) {
+    if (vec->n == vec->cap) {
+        vec->cap = vec->cap ? vec->cap * 2 : 64;
+        vec->data = (Entry*)realloc(vec->data, vec->cap * sizeof(Entry));
+        if (!vec->data) die("out of memory");
+    }
+    vec->data[vec->n++] = e;
+}
+
+static size_t section_end(const FileResult *res, size_t i) {
+    return (i + 1 < res->sections.n) ? res->sections.data[i + 1].off : res->out.len;
+}
+
+/* A section survives the merge only if no earlier input claimed its USR. */
+static bool section_is_kept(const FileResult *res, const Section *sec) {
+    return !sec->usr || usr_owner(sec->usr, sec->usr_hash) == res->index;
+}
+
+static char *dup_or_null(const char *s) {
+    return s ? dup_range(s, strlen(s)) : NULL;
+}
+
+/* Fold one file's symbols into the global tables, preserving the order a
+ * serial run would have produced. */
+static void merge_file_symbols(FileResult *res) {
+    for (size_t i = 0; i < res->sections.n; ++i) {
+        Section *sec = &res->sections.data[i];
+        if (!section_is_kept(res, sec)) continue;
+        EntryVec *vec = sec->kind == SECTION_MACRO ? &g_macros
+                      : sec->kind == SECTION_TYPE ? &g_types : &g_functions;
+        if (g_watch) {
+            // Watched results are merged again after every change.
+            Entry e = { dup_or_null(sec->entry.name), dup_or_null(sec->entry.anchor), dup_or_null(sec->entry.kind), res->index,
+                        sec->usr, dup_or_null(sec->entry.decl), dup_or_null(sec->entry.path), sec->entry.line };
+            entryvec_push(vec, e);
+            continue;
+        }
+        sec->entry.file = res->index;
+        sec->entry.usr = sec->usr;
+        entryvec_push(vec, sec->entry);
+        // The global table owns the strings now.
+        memset(&sec->entry, 0, sizeof(sec->entry));
+    }
+}
+
+/* Copy out[from, to) into `dst`, linking the docstrings in that range.
+ * `*span` walks res->docs in step with the offsets. */
+static void link_range(StrBuf *dst, const FileResult *res, size_t from, size_t to, size_t *span) {
+    const DocSpanVec *docs = &res->docs;
+    while (*span < docs->n && docs->data[*span].off < from) (*span)++;
+    size_t pos = from;
+    while (*span < docs->n && docs->data[*span].off < to) {
+        const DocSpan *d = &docs->data[*span];
+        sb_append_n(dst, res->out.buf + pos, d->off - pos);
+        Phase outer = stats_enter(PHASE_LINK);
+        link_docstring_segment(dst, res->out.buf + d->off, d->len);
+        stats_leave(outer);
+        pos = d->off + d->len;
+        (*span)++;
+    }
+    sb_append_n(dst, res->out.buf + pos, to - pos);
+}
+
+/* fwrite, charged to the write phase and the byte counter. */
+static void write_out(const StrBuf *sb, FILE *fp) {
+    Phase outer = stats_enter(PHASE_WRITE);
+    fwrite(sb->buf, 1, sb->len, fp);
+    if (t_stats) t_stats->bytes += sb->len;
+    stats_leave(outer);
+}
+
+/* -o FILE: each section is preceded by an HTML comment carrying a hash of
+ * its rendered text, so tools reading the document can tell which sections
+ * changed without diffing them. */
+static bool g_section_hashes;
+
+static size_t section_marker(char *buf, size_t cap, const StrBuf *sb) {
+    if (!g_section_hashes || !sb->len) return 0;
+    Digest d = digest_bytes(sb->buf, sb->len);
+    int n = snprintf(buf, cap, "<!-- doc_gen:section %016llx%016llx -->\n",
+                     (unsigned long long)d.a, (unsigned long long)d.b);
+    return n > 0 && (size_t)n < cap ? (size_t)n : 0;
+}
+
+/* Write one rendered section, after its marker if any. */
+static void write_section(const StrBuf *sb, FILE *fp) {
+    char marker[64];
+    size_t n = section_marker(marker, sizeof(marker), sb);
+    if (n) {
+        StrBuf m = { marker, n, sizeof(marker) };
+        write_out(&m, fp);
+    }
+    write_out(sb, fp);
+}
+
+static void append_section(StrBuf *dst, const StrBuf *sb) {
+    char marker[64];
+    size_t n = section_marker(marker, sizeof(marker), sb);
+    sb_append_n(dst, marker, n);
+    sb_append_n(dst, sb->buf, sb->len);
+}
+
+/* Write one file's surviving sections to `fp` and release its buffers.
+ * Text goes through `scratch` one section at a time, so beyond the per-file
+ * results only the largest section is ever held twice. */
+static void write_file_result(FileResult *res, StrBuf *scratch, FILE *fp) {
+    t_stats = g_stats ? &res->stats : NULL;
+    uint64_t start = trace_begin();
+    size_t kept = 0;
+    size_t span = 0;
+    size_t head = res->sections.n ? res->sections.data[0].off : res->out.len;
+    scratch->len = 0;
+    link_range(scratch, res, 0, head, &span);
+    write_section(scratch, fp);
+    for (size_t i = 0; i < res->sections.n; ++i) {
+        Section *sec = &res->sections.data[i];
+        if (!section_is_kept(res, sec)) continue;
+        if (t_stats) t_stats->emitted[sec->kind]++;
+        kept++;
+        scratch->len = 0;
+        link_range(scratch, res, sec->off, section_end(res, i), &span);
+        write_section(scratch, fp);
+    }
+    trace_end("output", start, res->path, "symbols", kept);
+    t_stats = NULL;
+}
+
+static void free_file_result(FileResult *res) {
+    free_sections(&res->sections);
+    free(res->docs.data);
+    res->docs.data = NULL;
+    res->docs.n = res->docs.cap = 0;
+    sb_free(&res->out);
+}
+
+/* Digest of every merged symbol's name and anchor: what docstring links
+ * resolve against. */
+static Digest symbols_digest(void) {
+    Hasher h = {{0, 0}};
+    const EntryVec *vecs[] = { &g_functions, &g_types, &g_macros };
+    for (size_t v = 0; v < 3; ++v) {
+        for (size_t i = 0; i < vecs[v]->n; ++i) {
+            hasher_add_str(&h, vecs[v]->data[i].name ? vecs[v]->data[i].name : "");
+            hasher_add_str(&h, vecs[v]->data[i].anchor ? vecs[v]->data[i].anchor : "");
+        }
+    }
+    return h.d;
+}
+
+static Digest g_symbols_digest;
+
+/* --watch keeps each input's linked text and only re-links an input when
+ * it was reparsed, when a different set of its sections survives the
+ * merge, or when the symbols links resolve against changed. */
+static void write_watched_result(FileResult *res, bool symbols_changed, FILE *fp) {
+    uint64_t kept_hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < res->sections.n; ++i) {
+        kept_hash ^= section_is_kept(res, &res->sections.data[i]) ? 1 : 2;
+        kept_hash *= 1099511628211ULL;
+    }
+    if (res->dirty || symbols_changed || kept_hash != res->kept_hash || !res->linked.buf) {
+        size_t span = 0;
+        size_t head = res->sections.n ? res->sections.data[0].off : res->out.len;
+        StrBuf scratch = {0};
+        res->linked.len = 0;
+        link_range(&scratch, res, 0, head, &span);
+        append_section(&res->linked, &scratch);
+        for (size_t i = 0; i < res->sections.n; ++i) {
+            Section *sec = &res->sections.data[i];
+            if (!section_is_kept(res, sec)) continue;
+            scratch.len = 0;
+            link_range(&scratch, res, sec->off, section_end(res, i), &span);
+            append_section(&res->linked, &scratch);
+        }
+        sb_free(&scratch);
+        res->kept_hash = kept_hash;
+    }
+    res->dirty = false;
+    if (res->linked.len) write_out(&res->linked, fp);
+}
+
+static void merge_all_symbols(FileResult *results, int nfiles) {
+    entryvec_free(&g_macros);
+    entryvec_free(&g_types);
+    entryvec_free(&g_functions);
+    // Links are resolved against the merged symbol index while each file
+    // is written, so the "link" span covers building that index.
+    uint64_t span = trace_begin();
+    for (int i = 0; i < nfiles; ++i) merge_file_symbols(&results[i]);
+    symindex_build(&g_symbol_index);
+    trace_end("link", span, NULL, "symbols", g_macros.n + g_types.n + g_functions.n);
+}
+
+static void print_summary(StrBuf *out) {
+    sb_append(out, "# API Documentation\n\n");
+    print_summary_section(out, "Macros", &g_macros, false);
+    print_summary_section(out, "Types", &g_types, true);
+    print_summary_section(out, "Functions", &g_functions, false);
+}
+
+/* Merge every input's symbols and write the whole document to `fp`. Outside
+ * --watch each input's buffers are released as soon as it is written. */
+static void write_document(FileResult *results, int nfiles, FILE *fp, Stats *summary_stats) {
+    merge_all_symbols(results, nfiles);
+    t_stats = summary_stats;
+    uint64_t span = trace_begin();
+    StrBuf scratch = {0};
+    print_summary(&scratch);
+    write_section(&scratch, fp);
+    trace_end("output", span, "(summary)", NULL, 0);
+    t_stats = NULL;
+    if (g_watch) {
+        Digest d = symbols_digest();
+        bool changed = d.a != g_symbols_digest.a || d.b != g_symbols_digest.b;
+        g_symbols_digest = d;
+        for (int i = 0; i < nfiles; ++i) write_watched_result(&results[i], changed, fp);
+    } else {
+        for (int i = 0; i < nfiles; ++i) {
+            write_file_result(&results[i], &scratch, fp);
+            free_file_result(&results[i]);
+        }
+    }
+    sb_free(&scratch);
+}
+
+/* -o FILE is written to a temporary beside it, which replaces FILE with a
+ * rename only if the bytes differ. An unchanged regen leaves FILE and its
+ * mtime alone, and readers never see a half-written document. */
+typedef struct {
+    const char *path;
+    char tmp[4200];
+    FILE *fp;
+} OutputFile;
+
+static FILE *output_open(OutputFile *o, const char *path) {
+    o->path = path;
+    snprintf(o->tmp, sizeof(o->tmp), "%s.%ld.tmp", path, (long)getpid());
+    o->fp = fopen(o->tmp, "wb");
+    if (!o->fp) {
+        fprintf(stderr, "error: cannot write %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    return o->fp;
+}
+
+static bool files_equal(const char *a, const char *b) {
+    struct stat st_a, st_b;
+    if (stat(a, &st_a) != 0 || stat(b, &st_b) != 0 || st_a.st_size != st_b.st_size) return false;
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = fa && fb;
+    char ba[65536], bb[65536];
+    while (same) {
+        size_t na = fread(ba, 1, sizeof(ba), fa);
+        size_t nb = fread(bb, 1, sizeof(bb), fb);
+        if (na != nb || memcmp(ba, bb, na) != 0) same = false;
+        if (na < sizeof(ba)) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+/* Returns whether FILE changed. A replaced FILE keeps its permissions. */
+static bool output_commit(OutputFile *o) {
+    struct stat st;
+    if (stat(o->path, &st) == 0) fchmod(fileno(o->fp), st.st_mode & 07777);
+    if (fclose(o->fp) != 0) {
+        remove(o->tmp);
+        fprintf(stderr, "error: failed to write %s\n", o->path);
+        exit(1);
+    }
+    o->fp = NULL;
+    if (files_equal(o->tmp, o->path)) {
+        remove(o->tmp);
+        return false;
+    }
+    if (rename(o->tmp, o->path) != 0) {
+        int err = errno;
+        remove(o->tmp);
+        fprintf(stderr, "error: cannot replace %s: %s\n", o->path, strerror(err));
+        exit(1);
+    }
+    return true;
+}
+
+/* Name each input's --split shard after its path: anything but letters,
+ * digits, '.', '-' and '_' becomes '_', and a -N suffix separates paths
+ * that end up with the same name. */
+static void shards_assign(const FileResult *results, int nfiles) {
+    g_shards = (char**)calloc((size_t)nfiles, sizeof(char*));
+    if (!g_shards) die("out of memory");
+    StrSet taken = {0};
+    set_add(&taken, "index.md");
+    StrBuf name = {0};
+    for (int i = 0; i < nfiles; ++i) {
+        const char *p = results[i].path;
+        for (;;) {
+            if (*p == '/') p++;
+            else if (p[0] == '.' && p[1] == '/') p += 2;
+            else break;
+        }
+        name.len = 0;
+        for (; *p; ++p) {
+            bool keep = isalnum((unsigned char)*p) || *p == '.' || *p == '-' || *p == '_';
+            sb_append_char(&name, keep ? *p : '_');
+        }
+        if (!name.len) sb_append(&name, "input");
+        size_t base = name.len;
+        sb_append(&name, ".md");
+        for (int n = 2;; ++n) {
+            size_t before = taken.n;
+            set_add(&taken, name.buf);
+            if (taken.n != before) break;
+            name.len = base;
+            sb_appendf(&name, "-%d.md", n);
+        }
+        g_shards[i] = strdup(name.buf);
+    }
+    sb_free(&name);
+    set_free(&taken);
+}
+
+static void shards_free(int nfiles) {
+    for (int i = 0; i < nfiles && g_shards; ++i) free(g_shards[i]);
+    free(g_shards);
+    g_shards = NULL;
+}
+
+typedef struct {
+    FileResult *results;
+    int nfiles;
+    const char *dir;
+    atomic_int next;
+} ShardQueue;
+
+static void *shard_worker(void *arg) {
+    ShardQueue *q = (ShardQueue*)arg;
+    StrBuf scratch = {0};
+    char path[4096];
+    for (;;) {
+        int i = atomic_fetch_add(&q->next, 1);
+        if (i >= q->nfiles) break;
+        snprintf(path, sizeof(path), "%s/%s", q->dir, g_shards[i]);
+        OutputFile o;
+        t_shard = i;
+        write_file_result(&q->results[i], &scratch, output_open(&o, path));
+        free_file_result(&q->results[i]);
+        output_commit(&o);
+    }
+    t_shard = -1;
+    sb_free(&scratch);
+    return NULL;
+}
+
+/* --split DIR: DIR/index.md gets the summary and a list of the shards, and
+ * each input is written to its own shard by up to `jobs` threads. */
+static void write_split(FileResult *results, int nfiles, const char *dir, int jobs, Stats *summary_stats) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) die("cannot create --split directory");
+    shards_assign(results, nfiles);
+    merge_all_symbols(results, nfiles);
+
+    t_stats = summary_stats;
+    uint64_t span = trace_begin();
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/index.md", dir);
+    OutputFile index;
+    FILE *fp = output_open(&index, path);
+    StrBuf scratch = {0};
+    print_summary(&scratch);
+    write_section(&scratch, fp);
+    scratch.len = 0;
+    sb_append(&scratch, "## Files\n\n");
+    for (int i = 0; i < nfiles; ++i) sb_appendf(&scratch, "- [`%s`](%s)\n", results[i].path, g_shards[i]);
+    sb_append(&scratch, "\n");
+    write_section(&scratch, fp);
+    sb_free(&scratch);
+    output_commit(&index);
+    trace_end("output", span, "(index)", NULL, 0);
+    t_stats = NULL;
+
+    ShardQueue queue = { results, nfiles, dir, 0 };
+    if (jobs > nfiles) jobs = nfiles;
+    pthread_t *threads = jobs > 1 ? (pthread_t*)malloc((size_t)jobs * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    for (; threads && started < jobs; ++started) {
+        if (pthread_create(&threads[started], NULL, shard_worker, &queue) != 0) break;
+    }
+    if (started == 0) shard_worker(&queue);
+    for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+/* --emit-index PATH: every merged symbol, written as PATH.json and PATH.idx.
+ * Both list the symbols sorted by name, then kind, then anchor.
+ *
+ * PATH.idx can be mmapped and binary-searched in place. All integers are
+ * little-endian u32; strings are offsets into the string table.
+ *
+ *     header   "DGIDX1\0\0", count, record size (40), string table offset,
+ *              string table size, 2 reserved
+ *     records  name, kind (0 macro, 1 type, 2 function), detail, anchor,
+ *              page, input, usr, path, decl, line
+ *     strings  NUL-terminated, sorted and deduplicated; "" is at offset 0
+ *
+ * `page` is the --split file holding the symbol, or "" for a single
+ * document; `detail` is the kind shown next to a type in the summary. */
+typedef struct {
+    const Entry *e;
+    uint32_t kind;
+} IndexItem;
+
+static int index_item_cmp(const void *a, const void *b) {
+    const IndexItem *x = (const IndexItem*)a, *y = (const IndexItem*)b;
+    int c = strcmp(x->e->name, y->e->name);
+    if (c != 0) return c;
+    if (x->kind != y->kind) return x->kind < y->kind ? -1 : 1;
+    return strcmp(x->e->anchor, y->e->anchor);
+}
+
+static int str_ptr_cmp(const void *a, const void *b) {
+    return strcmp(*(const char *const*)a, *(const char *const*)b);
+}
+
+static void put_le32(StrBuf *sb, uint32_t v) {
+    char b[4] = { (char)(v & 0xff), (char)((v >> 8) & 0xff), (char)((v >> 16) & 0xff), (char)(v >> 24) };
+    sb_append_n(sb, b, sizeof(b));
+}
+
+static void sb_append_json_field(StrBuf *sb, const char *key, const char *value) {
+    sb_appendf(sb, ",\"%s\":", key);
+    if (value) sb_append_json_string(sb, value);
+    else sb_append(sb, "null");
+}
+
+#define INDEX_FIELDS 8 // string fields per record
+
+static void index_item_strings(const IndexItem *it, const FileResult *results, const char *out[INDEX_FIELDS]) {
+    const Entry *e = it->e;
+    out[0] = e->name;
+    out[1] = e->kind ? e->kind : "";
+    out[2] = e->anchor;
+    out[3] = g_shards ? g_shards[e->file] : "";
+    out[4] = results[e->file].path;
+    out[5] = e->usr ? e->usr : "";
+    out[6] = e->path ? e->path : "";
+    out[7] = e->decl ? e->decl : "";
+}
+
+static void emit_index(const char *base, const FileResult *results) {
+    static const char *const kind_names[] = { "macro", "type", "function" };
+    const EntryVec *vecs[] = { &g_macros, &g_types, &g_functions };
+    size_t n = g_macros.n + g_types.n + g_functions.n;
+    IndexItem *items = (IndexItem*)malloc((n ? n : 1) * sizeof(IndexItem));
+    if (!items) die("out of memory");
+    size_t count = 0;
+    for (uint32_t k = 0; k < 3; ++k) {
+        for (size_t i = 0; i < vecs[k]->n; ++i) {
+            if (!vecs[k]->data[i].name || !vecs[k]->data[i].anchor) continue;
+            items[count].e = &vecs[k]->data[i];
+            items[count].kind = k;
+            count++;
+        }
+    }
+    qsort(items, count, sizeof(IndexItem), index_item_cmp);
+
+    char path[4096];
+    OutputFile o;
+    StrBuf sb = {0};
+    sb_append(&sb, "{\"version\":1,\"symbols\":[");
+    for (size_t i = 0; i < count; ++i) {
+        const Entry *e = items[i].e;
+        sb_append(&sb, i ? ",\n" : "\n");
+        sb_append(&sb, "{\"name\":");
+        sb_append_json_string(&sb, e->name);
+        sb_append_json_field(&sb, "kind", kind_names[items[i].kind]);
+        sb_append_json_field(&sb, "detail", e->kind);
+        sb_append_json_field(&sb, "anchor", e->anchor);
+        sb_append_json_field(&sb, "page", g_shards ? g_shards[e->file] : "");
+        sb_append_json_field(&sb, "input", results[e->file].path);
+        sb_append_json_field(&sb, "usr", e->usr);
+        sb_append_json_field(&sb, "path", e->path);
+        sb_appendf(&sb, ",\"line\":%u", e->line);
+        sb_append_json_field(&sb, "decl", e->decl);
+        sb_append_char(&sb, '}');
+    }
+    sb_append(&sb, "\n]}\n");
+    snprintf(path, sizeof(path), "%s.json", base);
+    FILE *fp = output_open(&o, path);
+    fwrite(sb.buf, 1, sb.len, fp);
+    output_commit(&o);
+
+    // The string table: every distinct string once, in sorted order.
+    size_t nstrs = count * INDEX_FIELDS + 1;
+    const char **strs = (const char**)malloc(nstrs * sizeof(char*));
+    uint32_t *offsets = (uint32_t*)malloc(nstrs * sizeof(uint32_t));
+    if (!strs || !offsets) die("out of memory");
+    strs[0] = "";
+    for (size_t i = 0; i < count; ++i) index_item_strings(&items[i], results, strs + 1 + i * INDEX_FIELDS);
+    qsort(strs, nstrs, sizeof(char*), str_ptr_cmp);
+    size_t nunique = 0;
+    StrBuf table = {0};
+    for (size_t i = 0; i < nstrs; ++i) {
+        if (nunique && strcmp(strs[nunique - 1], strs[i]) == 0) continue;
+        strs[nunique] = strs[i];
+        offsets[nunique] = (uint32_t)table.len;
+        sb_append_n(&table, strs[i], strlen(strs[i]) + 1);
+        nunique++;
+    }
+
+    sb.len = 0;
+    uint32_t strings_at = 32 + (uint32_t)(count * INDEX_RECORD_SIZE);
+    sb_append_n(&sb, INDEX_MAGIC, 8);
+    put_le32(&sb, (uint32_t)count);
+    put_le32(&sb, INDEX_RECORD_SIZE);
+    put_le32(&sb, strings_at);
+    put_le32(&sb, (uint32_t)table.len);
+    put_le32(&sb, 0);
+    put_le32(&sb, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const char *fields[INDEX_FIELDS];
+        uint32_t at[INDEX_FIELDS];
+        index_item_strings(&items[i], results, fields);
+        for (int f = 0; f < INDEX_FIELDS; ++f) {
+            const char **hit = (const char**)bsearch(&fields[f], strs, nunique, sizeof(char*), str_ptr_cmp);
+            at[f] = offsets[hit - strs];
+        }
+        put_le32(&sb, at[0]); // name
+        put_le32(&sb, items[i].kind);
+        for (int f = 1; f < INDEX_FIELDS; ++f) put_le32(&sb, at[f]);
+        put_le32(&sb, items[i].e->line);
+    }
+    sb_append_n(&sb, table.buf, table.len);
+    snprintf(path, sizeof(path), "%s.idx", base);
+    fp = output_open(&o, path);
+    fwrite(sb.buf, 1, sb.len, fp);
+    output_commit(&o);
 
-    // Only handle top-level decls
-    if (!clang_isDeclaration(k) && k != CXCursor_MacroDefinition && k != CXCursor_EnumDecl)
-        return CXChildVisit_Recurse;
+    sb_free(&table);
+    sb_free(&sb);
+    free(strs);
+    free(offsets);
+    free(items);
+}
 
-    // Dedup by USR when available (macros often lack USR)
-    char *usr = cursor_usr(c);
-    bool have_usr = usr && *usr;
-    if (have_usr && set_has(&ctx->seen, usr)) { free(usr); return CXChildVisit_Continue; }
-    if (have_usr) set_add(&ctx->seen, usr);
-    free(usr);
+static void watch_collect_dep(CXFile file, CXSourceLocation *stack, unsigned depth, CXClientData data) {
+    FileResult *res = (FileResult*)data;
+    if (depth > 0 && clang_Location_isInSystemHeader(clang_getLocationForOffset(res->tu, file, 0))) return;
+    CXString name = clang_File_tryGetRealPathName(file);
+    const char *c = clang_getCString(name);
+    if (!c || !*c) {
+        clang_disposeString(name);
+        name = clang_getFileName(file);
+        c = clang_getCString(name);
+    }
+    if (c && *c) {
+        char abs[4096];
+        absolute_path(c, abs, sizeof(abs));
+        set_add(&res->deps, abs);
+    }
+    clang_disposeString(name);
+}
 
-    switch (k) {
-        case CXCursor_FunctionDecl:
-            // Emit the first declaration/definition we encounter; USR dedupe avoids repeats.
-            emit_function(c);
-            break;
-        case CXCursor_StructDecl: emit_record(c, ""); break;
-        case CXCursor_UnionDecl:  emit_record(c, "");  break;
-        case CXCursor_EnumDecl:   emit_record(c, "");   break;
-        case CXCursor_TypedefDecl: emit_typedef(c); break;
-        case CXCursor_MacroDefinition:
-            // Skip system headers, but allow project/local headers included by the file.
-            if (!cursor_is_in_system_header(c)) {
-                emit_macro(c, ctx->tu);
+/* The files a watched input was built from: itself and every header it
+ * included outside the system directories, by absolute path. */
+static void watch_collect_deps(FileResult *res) {
+    set_free(&res->deps);
+    clang_getInclusions(res->tu, watch_collect_dep, res);
+}
+
+#ifdef __linux__
+/* One inotify watch per directory holding a dependency. Watching the
+ * directory rather than the file catches editors that save by renaming a
+ * new file over the old one. The same directory may be reached under
+ * several spellings, which inotify folds into one watch descriptor. */
+typedef struct {
+    int wd;
+    char *dir;
+} WatchDir;
+
+static struct {
+    int fd;
+    WatchDir *dirs;
+    size_t n, cap;
+} g_watcher = { -1, NULL, 0, 0 };
+
+static void watcher_add_file(const char *path) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return;
+    char *dir = dup_range(path, slash == path ? 1 : (size_t)(slash - path));
+    for (size_t i = 0; i < g_watcher.n; ++i) {
+        if (strcmp(g_watcher.dirs[i].dir, dir) == 0) {
+            free(dir);
+            return;
+        }
+    }
+    int wd = inotify_add_watch(g_watcher.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+    if (wd < 0) {
+        fprintf(stderr, "warning: cannot watch %s: %s\n", dir, strerror(errno));
+        free(dir);
+        return;
+    }
+    if (g_watcher.n == g_watcher.cap) {
+        g_watcher.cap = g_watcher.cap ? g_watcher.cap * 2 : 16;
+        g_watcher.dirs = (WatchDir*)realloc(g_watcher.dirs, g_watcher.cap * sizeof(WatchDir));
+        if (!g_watcher.dirs) die("out of memory");
+    }
+    g_watcher.dirs[g_watcher.n].wd = wd;
+    g_watcher.dirs[g_watcher.n].dir = dir;
+    g_watcher.n++;
+}
+
+static volatile sig_atomic_t g_watch_stop;
+
+static void watch_stop(int sig) {
+    (void)sig;
+    g_watch_stop = 1;
+}
+
+/* Block until something in a watched directory changes, then keep reading
+ * until the events stop for a moment so one save triggers one rebuild. */
+static void watcher_wait(StrSet *changed) {
+    _Alignas(struct inotify_event) char buf[16384];
+    int timeout = -1;
+    for (;;) {
+        struct pollfd pfd = { g_watcher.fd, POLLIN, 0 };
+        int rc = poll(&pfd, 1, timeout);
+        if (rc < 0) {
+            if (errno != EINTR) die("poll on inotify descriptor failed");
+            if (g_watch_stop) return;
+            continue;
+        }
+        if (rc == 0) return;
+        ssize_t n = read(g_watcher.fd, buf, sizeof(buf));
+        if (n <= 0) continue;
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            for (size_t i = 0; ev->len && i < g_watcher.n; ++i) {
+                if (g_watcher.dirs[i].wd != ev->wd) continue;
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/%s", strcmp(g_watcher.dirs[i].dir, "/") == 0 ? "" : g_watcher.dirs[i].dir,
+                         ev->name);
+                set_add(changed, path);
             }
-            break;
-        default: break;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+        if (changed->n) timeout = 30;
     }
-    return CXChildVisit_Recurse;
 }
 
-static void process_file(CXIndex idx, const char *path, int clang_argc, const char **clang_argv) {
-    char *file_doc = extract_file_doc(path);
-    bool have_file_doc = file_doc && *file_doc;
-    if (have_file_doc) {
-        filedocs_add(&g_file_docs, path, file_doc);
+static bool deps_touched(const FileResult *res, const StrSet *changed) {
+    for (size_t i = 0; i < changed->n; ++i) {
+        for (size_t k = 0; k < res->deps.n; ++k) {
+            if (strcmp(res->deps.data[k], changed->data[i]) == 0) return true;
+        }
+    }
+    return false;
+}
+
+static void watch_reparse(CXIndex idx, FileResult *res, int clang_argc, const char **clang_argv) {
+    if (!res->tu) {
+        process_file(idx, res, clang_argc, clang_argv);
+        return;
+    }
+    size_t contents_len = 0;
+    char *contents = read_file(res->path, &contents_len);
+    char *file_doc = extract_file_doc(contents, contents_len);
+    struct CXUnsavedFile unsaved = { res->path, contents, (unsigned long)contents_len };
+    int rc = clang_reparseTranslationUnit(res->tu, contents ? 1 : 0, contents ? &unsaved : NULL,
+                                          clang_defaultReparseOptions(res->tu));
+    free(contents);
+    if (rc != 0) {
+        // The TU is unusable after a failed reparse; the next save parses
+        // it from scratch. Its dependencies stay watched until then.
+        fprintf(stderr, "failed to reparse: %s\n", res->path);
+        clang_disposeTranslationUnit(res->tu);
+        res->tu = NULL;
     } else {
-        free(file_doc);
-        file_doc = NULL;
+        visit_tu(res, res->tu, file_doc && *file_doc ? file_doc : NULL);
+        watch_collect_deps(res);
+    }
+    free(file_doc);
+    arena_reset(&t_arena);
+}
+
+static bool write_output_file(const char *out_path, FileResult *results, int nfiles) {
+    OutputFile o;
+    write_document(results, nfiles, output_open(&o, out_path), NULL);
+    return output_commit(&o);
+}
+
+/* --watch: after the first run, reparse only the inputs whose own file or
+ * one of their headers changed and rewrite `out_path`. Symbol ownership is
+ * rebuilt from scratch each round: untouched inputs re-claim the symbols
+ * they already rendered and reparsed ones claim theirs as they are
+ * visited. Returns on SIGINT or SIGTERM. */
+static void watch_loop(WorkQueue *q, const char *out_path) {
+    g_watcher.fd = inotify_init1(IN_CLOEXEC);
+    if (g_watcher.fd < 0) die("inotify_init1 failed");
+    // No SA_RESTART, so the signal interrupts poll() and we get to clean up
+    // (the --pch temporary in particular).
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = watch_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    for (int i = 0; i < q->nfiles; ++i) {
+        FileResult *res = &q->results[i];
+        // Inputs that failed to parse are still watched for a fix.
+        if (!res->deps.n) {
+            char abs[4096];
+            absolute_path(res->path, abs, sizeof(abs));
+            set_add(&res->deps, abs);
+        }
+        for (size_t k = 0; k < res->deps.n; ++k) watcher_add_file(res->deps.data[k]);
+    }
+    fprintf(stderr, "watching %zu directories for changes\n", g_watcher.n);
+    CXIndex idx = NULL, local_idx = NULL;
+    while (!g_watch_stop) {
+        StrSet changed = {0};
+        watcher_wait(&changed);
+        if (g_watch_stop) {
+            set_free(&changed);
+            break;
+        }
+        uint64_t start = clock_ns(CLOCK_MONOTONIC);
+        int ndirty = 0;
+        for (int i = 0; i < q->nfiles; ++i) {
+            q->results[i].dirty = deps_touched(&q->results[i], &changed);
+            ndirty += q->results[i].dirty;
+        }
+        set_free(&changed);
+        if (!ndirty) continue;
+
+        UsrTable old[USR_SHARDS];
+        for (int s = 0; s < USR_SHARDS; ++s) {
+            old[s] = g_usr_registry[s].table;
+            memset(&g_usr_registry[s].table, 0, sizeof(UsrTable));
+        }
+        for (int i = 0; i < q->nfiles; ++i) {
+            FileResult *res = &q->results[i];
+            if (res->dirty) continue;
+            for (size_t k = 0; k < res->sections.n; ++k) {
+                Section *sec = &res->sections.data[k];
+                bool owned = false;
+                if (sec->usr) sec->usr = usr_claim(sec->usr, sec->usr_hash, i, &owned);
+            }
+        }
+        for (int i = 0; i < q->nfiles; ++i) {
+            FileResult *res = &q->results[i];
+            if (!res->dirty) continue;
+            free_file_result(res);
+            CXIndex use;
+            if (q->pch && i > 0) {
+                if (!local_idx) {
+                    local_idx = index_acquire(/*excludeDeclsFromPCH=*/1);
+                    index_keep(local_idx, 1);
+                }
+                use = local_idx;
+            } else {
+                if (!idx) {
+                    idx = index_acquire(/*excludeDeclsFromPCH=*/0);
+                    index_keep(idx, 0);
+                }
+                use = idx;
+            }
+            if (res->args) watch_reparse(use, res, res->nargs, (const char**)res->args);
+            else watch_reparse(use, res, q->clang_argc, q->clang_argv);
+            for (size_t k = 0; k < res->deps.n; ++k) watcher_add_file(res->deps.data[k]);
+        }
+        for (int s = 0; s < USR_SHARDS; ++s) usrtable_free(&old[s]);
+
+        bool rewritten = write_output_file(out_path, q->results, q->nfiles);
+        if (g_emit_index) emit_index(g_emit_index, q->results);
+        fprintf(stderr, "%s %s in %.1f ms (%d input%s reparsed)\n", rewritten ? "updated" : "unchanged", out_path,
+                (double)(clock_ns(CLOCK_MONOTONIC) - start) / 1e6, ndirty, ndirty == 1 ? "" : "s");
     }
+    for (size_t i = 0; i < g_watcher.n; ++i) free(g_watcher.dirs[i].dir);
+    free(g_watcher.dirs);
+    close(g_watcher.fd);
+}
+#endif
+
+/* The shared prefix header, compiled once and fed to every input with
+ * -include-pch so each TU skips re-lexing the common include chain. */
+typedef struct {
+    char path[4096];
+    const char **argv; // clang args + "-include-pch <path>"
+    int argc;
+    const char *header;
+    Digest inclusions; // everything the prefix pulls in
+} Pch;
+
+typedef struct {
+    Hasher *salt;
+    CXTranslationUnit tu;
+} PchInclusions;
+
+static void hash_pch_inclusion(CXFile file, CXSourceLocation *stack, unsigned depth, CXClientData data) {
+    PchInclusions *inc = (PchInclusions*)data;
+    char *name = dup_cx(clang_getFileName(file));
+    hasher_add_str(inc->salt, name);
+    size_t len = 0;
+    const char *contents = clang_getFileContents(inc->tu, file, &len);
+    hasher_add(inc->salt, contents ? contents : "", contents ? len : 0);
+}
+
+static void build_pch(Pch *pch, const char *header, int clang_argc, const char **clang_argv) {
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || !*tmpdir) tmpdir = "/tmp";
+    snprintf(pch->path, sizeof(pch->path), "%s/doc_gen-XXXXXX", tmpdir);
+    int fd = mkstemp(pch->path);
+    if (fd < 0) die("cannot create temporary file for --pch");
+    close(fd);
+
+    CXIndex idx = index_acquire(/*excludeDeclsFromPCH=*/0);
     unsigned opts = CXTranslationUnit_DetailedPreprocessingRecord |
-                    CXTranslationUnit_IncludeBriefCommentsInCodeCompletion;
+                    CXTranslationUnit_ForSerialization |
+                    CXTranslationUnit_Incomplete;
     CXTranslationUnit tu = NULL;
     enum CXErrorCode ec = clang_parseTranslationUnit2(
-        idx, path, clang_argv, clang_argc, NULL, 0, opts, &tu);
+        idx, header, clang_argv, clang_argc, NULL, 0, opts, &tu);
     if (ec != CXError_Success || !tu) {
-        fprintf(stderr, "failed to parse: %s (ec=%d)\n", path, ec);
-        return;
+        fprintf(stderr, "failed to parse --pch header: %s (ec=%d)\n", header, ec);
+        remove(pch->path);
+        exit(1);
     }
-
-    Ctx ctx = {0};
-    ctx.tu = tu;
-    fprintf(g_out, "## File: %s\n\n", path);
-    if (have_file_doc) {
-        char *adjusted = bump_markdown_headers(file_doc);
-        const char *doc = adjusted ? adjusted : file_doc;
-        write_docstring_block(doc);
-        free(adjusted);
+    // Everything the prefix pulls in shapes every input's output, so it all
+    // goes into the cache key.
+    Hasher salt = {{0, 0}};
+    PchInclusions inc = { &salt, tu };
+    clang_getInclusions(tu, hash_pch_inclusion, &inc);
+    pch->inclusions = salt.d;
+    if (clang_saveTranslationUnit(tu, pch->path, clang_defaultSaveOptions(tu)) != 0) {
+        remove(pch->path);
+        die("failed to write precompiled header");
     }
-    clang_visitChildren(clang_getTranslationUnitCursor(tu), tu_visitor, &ctx);
     clang_disposeTranslationUnit(tu);
+    index_release(idx, 0);
+    arena_reset(&t_arena);
+
+    pch->header = header;
+    pch->argc = clang_argc + 2;
+    pch->argv = (const char**)malloc((size_t)pch->argc * sizeof(char*));
+    if (!pch->argv) die("out of memory");
+    for (int i = 0; i < clang_argc; ++i) pch->argv[i] = clang_argv[i];
+    pch->argv[clang_argc] = "-include-pch";
+    pch->argv[clang_argc + 1] = pch->path;
+}
+
+static void pch_free(Pch *pch) {
+    if (!pch->argv) return;
+    remove(pch->path);
+    free(pch->argv);
+    pch->argv = NULL;
+    pch->argc = 0;
+}
+
+/* Prefix headers compiled so far. --manifest jobs naming the same header
+ * with the same clang args share one build. Entries are allocated one by
+ * one because their argv points at their own path. */
+typedef struct {
+    Pch **data;
+    size_t n, cap;
+} PchCache;
+
+static const Pch *pch_get(PchCache *cache, const char *header, int clang_argc, const char **clang_argv) {
+    for (size_t i = 0; i < cache->n; ++i) {
+        const Pch *pch = cache->data[i];
+        if (strcmp(pch->header, header) != 0 || pch->argc != clang_argc + 2) continue;
+        int k = 0;
+        while (k < clang_argc && strcmp(pch->argv[k], clang_argv[k]) == 0) ++k;
+        if (k == clang_argc) return pch;
+    }
+    if (cache->n == cache->cap) {
+        cache->cap = cache->cap ? cache->cap * 2 : 4;
+        cache->data = (Pch**)realloc(cache->data, cache->cap * sizeof(Pch*));
+        if (!cache->data) die("out of memory");
+    }
+    Pch *pch = (Pch*)calloc(1, sizeof(Pch));
+    if (!pch) die("out of memory");
+    build_pch(pch, header, clang_argc, clang_argv);
+    cache->data[cache->n++] = pch;
+    return pch;
+}
+
+static void pch_cache_free(PchCache *cache) {
+    for (size_t i = 0; i < cache->n; ++i) {
+        pch_free(cache->data[i]);
+        free(cache->data[i]);
+    }
+    free(cache->data);
+    cache->data = NULL;
+    cache->n = cache->cap = 0;
+}
 
-    // cleanup set
-    set_free(&ctx.seen);
+/* Dependency-file options, which would make libclang write over the build's
+ * depfiles. -MF, -MT and -MQ take a value, separate or joined. */
+static bool compdb_drops_dep_option(const char *arg, bool *takes_value) {
+    *takes_value = false;
+    if (strcmp(arg, "-M") == 0 || strcmp(arg, "-MM") == 0 || strcmp(arg, "-MD") == 0 ||
+        strcmp(arg, "-MMD") == 0 || strcmp(arg, "-MP") == 0) return true;
+    if (strncmp(arg, "-MF", 3) == 0 || strncmp(arg, "-MT", 3) == 0 || strncmp(arg, "-MQ", 3) == 0) {
+        *takes_value = arg[3] == '\0';
+        return true;
+    }
+    return false;
+}
+
+/* --compdb: give an input the arguments its compile_commands.json entry was
+ * built with. Dropped are the compiler, the input itself, -c, -o FILE (or
+ * -oFILE), and the dependency-file options -M, -MM, -MD, -MMD, -MP and
+ * -MF/-MT/-MQ with their values. The entry's directory becomes
+ * -working-directory, and the shared clang args (including any
+ * -include-pch) follow. The input is addressed by absolute
+ * path from then on so reading it does not depend on our own cwd. */
+static void compdb_apply(FileResult *res, CXCompileCommand cmd, int shared_argc, const char **shared_argv) {
+    const char *dir = dup_cx(clang_CompileCommand_getDirectory(cmd));
+    const char *file = dup_cx(clang_CompileCommand_getFilename(cmd));
+    StrBuf abs = {0};
+    if (file[0] != '/') {
+        sb_append(&abs, dir);
+        sb_append_char(&abs, '/');
+    }
+    sb_append(&abs, file);
+    unsigned n = clang_CompileCommand_getNumArgs(cmd);
+    res->args = (char**)malloc(((size_t)n + 2 + (size_t)shared_argc) * sizeof(char*));
+    if (!res->args) die("out of memory");
+    int k = 0;
+    for (unsigned a = 1; a < n; ++a) {
+        const char *arg = dup_cx(clang_CompileCommand_getArg(cmd, a));
+        if (strcmp(arg, "-o") == 0) {
+            ++a;
+            continue;
+        }
+        if (strncmp(arg, "-o", 2) == 0) continue; // -oFILE
+        bool takes_value = false;
+        if (compdb_drops_dep_option(arg, &takes_value)) {
+            if (takes_value) ++a;
+            continue;
+        }
+        if (strcmp(arg, "-c") == 0 || strcmp(arg, "--") == 0 || strcmp(arg, file) == 0 ||
+            strcmp(arg, abs.buf) == 0) continue;
+        // The input may also be spelled relative to the entry's directory.
+        size_t dlen = strlen(dir);
+        if (arg[0] != '/' && strncmp(abs.buf, dir, dlen) == 0 && abs.buf[dlen] == '/' &&
+            strcmp(abs.buf + dlen + 1, arg) == 0) continue;
+        res->args[k++] = strdup(arg);
+    }
+    res->args[k++] = strdup("-working-directory");
+    res->args[k++] = strdup(dir);
+    for (int i = 0; i < shared_argc; ++i) res->args[k++] = strdup(shared_argv[i]);
+    res->nargs = k;
+    res->compdb_path = sb_detach(&abs);
+    res->path = res->compdb_path;
+    arena_reset(&t_arena);
+}
+
+/* Options that consume the argument after them. */
+static bool option_takes_value(const char *arg) {
+    static const char *const names[] = { "--ignore", "-j", "--jobs", "--cache-dir", "--pch", "--trace-out", "--compdb", "-o", "--manifest", "--split", "--emit-index", "--link-index", "--include-dir", "--exclude-path" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strcmp(arg, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+/* Options that take no argument. */
+static bool option_is_flag(const char *arg) {
+    static const char *const names[] = { "--fast", "--stats", "--watch", "--only-main-file" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strcmp(arg, names[i]) == 0) return true;
+    }
+    return false;
+}
+
+static void stats_add(Stats *dst, const Stats *src) {
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        dst->wall[p] += src->wall[p];
+        dst->cpu[p] += src->cpu[p];
+    }
+    dst->cursors += src->cursors;
+    dst->pruned += src->pruned;
+    dst->dedupe_hits += src->dedupe_hits;
+    for (int k = 0; k < 3; ++k) dst->emitted[k] += src->emitted[k];
+    dst->link_lookups += src->link_lookups;
+    dst->link_hits += src->link_hits;
+    dst->bytes += src->bytes;
+}
+
+static void print_stats_row(const char *label, const Stats *st) {
+    size_t len = strlen(label);
+    if (len > 32) fprintf(stderr, "...%-29s", label + len - 29);
+    else fprintf(stderr, "%-32s", label);
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        fprintf(stderr, " %7.2f/%-7.2f", st->wall[p] / 1e6, st->cpu[p] / 1e6);
+    }
+    fprintf(stderr, "\n");
+}
+
+/* The --stats report: one row per input, then totals and counters. */
+static void print_stats(const FileResult *results, int nfiles, const Stats *index) {
+    Stats total = {0};
+    fprintf(stderr, "\ndoc_gen stats (wall/cpu ms per phase; phases are exclusive)\n");
+    fprintf(stderr, "%-32s", "input");
+    for (int p = 0; p < PHASE_COUNT; ++p) fprintf(stderr, " %15s", phase_names[p]);
+    fprintf(stderr, "\n");
+    for (int i = 0; i < nfiles; ++i) {
+        print_stats_row(results[i].path, &results[i].stats);
+        stats_add(&total, &results[i].stats);
+    }
+    print_stats_row("(summary)", index);
+    stats_add(&total, index);
+    print_stats_row("total", &total);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "cursors visited     %llu\n", (unsigned long long)total.cursors);
+    fprintf(stderr, "cursors pruned      %llu\n", (unsigned long long)total.pruned);
+    fprintf(stderr, "usr dedupe hits     %llu\n", (unsigned long long)total.dedupe_hits);
+    fprintf(stderr, "macros emitted      %llu\n", (unsigned long long)total.emitted[SECTION_MACRO]);
+    fprintf(stderr, "types emitted       %llu\n", (unsigned long long)total.emitted[SECTION_TYPE]);
+    fprintf(stderr, "functions emitted   %llu\n", (unsigned long long)total.emitted[SECTION_FUNCTION]);
+    fprintf(stderr, "link lookups        %llu (%llu hits)\n",
+            (unsigned long long)total.link_lookups, (unsigned long long)total.link_hits);
+    fprintf(stderr, "bytes written       %llu\n", (unsigned long long)total.bytes);
+}
+
+static int parse_jobs(const char *arg) {
+    char *end = NULL;
+    long n = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || n < 0 || n > 1024) die("--jobs expects a number between 0 and 1024");
+    if (n == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = cpus > 0 ? cpus : 1;
+    }
+    return (int)n;
 }
 
 static void print_help(const char *prog) {
@@ -1322,7 +4194,386 @@ static void print_help(const char *prog) {
     printf("Generate Markdown documentation for C headers or sources.\n\n");
     printf("Options:\n");
     printf("  -h, --help          Show this help message and exit\n");
+    printf("  -o FILE             Write the documentation to FILE instead of stdout\n");
+    printf("  --split DIR         Write each input to its own file in DIR, with DIR/index.md\n");
+    printf("                      listing every symbol\n");
+    printf("  --emit-index PATH   Also write every symbol's name, kind, anchor, USR, location and\n");
+    printf("                      declaration to PATH.json and the binary PATH.idx\n");
+    printf("  --link-index F=URL  Link words this run does not define to symbols in another run's\n");
+    printf("                      --emit-index file F, at URL + page + #anchor (repeatable)\n");
     printf("  --ignore PATTERN    Skip symbols whose names match PATTERN (* and ? supported)\n");
+    printf("  --only-main-file    Only document declarations in the input itself, not its headers\n");
+    printf("  --include-dir GLOB  Only document declarations in files under a directory matching\n");
+    printf("                      GLOB (repeatable)\n");
+    printf("  --exclude-path GLOB Skip declarations in files whose path matches GLOB (repeatable)\n");
+    printf("  -j, --jobs N        Parse up to N inputs in parallel (0 = one per CPU, default 1)\n");
+    printf("  --cache-dir DIR     Reuse per-file results from DIR when inputs, headers and args are unchanged\n");
+    printf("  --pch HEADER        Precompile HEADER once and reuse it as the prefix of every input\n");
+    printf("  --compdb DIR        Parse each input with its flags from DIR/compile_commands.json;\n");
+    printf("                      with no inputs, document every file in the database\n");
+    printf("  --fast              Skip function bodies and declarations nested inside them\n");
+    printf("  --watch             Keep running and rewrite the -o file when an input or one of\n");
+    printf("                      its headers changes, reparsing only the affected inputs\n");
+    printf("  --stats             Print per-input phase timings and counters to stderr\n");
+    printf("  --trace-out FILE    Write Chrome trace events for each input's phases to FILE\n");
+    printf("  --manifest FILE     Run every job listed in FILE in this process (see README);\n");
+    printf("                      other options and clang args apply to all of them\n");
+}
+
+
+typedef struct {
+    const char **data;
+    int n, cap;
+} ArgVec;
+
+static void argvec_push(ArgVec *v, const char *s) {
+    if (v->n == v->cap) {
+        v->cap = v->cap ? v->cap * 2 : 16;
+        v->data = (const char**)realloc(v->data, (size_t)v->cap * sizeof(char*));
+        if (!v->data) die("out of memory");
+    }
+    v->data[v->n++] = s;
+}
+
+/* One documentation run. The command line describes a single job;
+ * --manifest lists many, which run one after another in this process.
+ * The strings are borrowed from argv or the manifest text. */
+typedef struct {
+    const char *name; // manifest section, NULL on the command line
+    ArgVec inputs;
+    ArgVec args; // clang args
+    ArgVec ignore;
+    const char *pch;
+    const char *compdb;
+    const char *output; // NULL for stdout
+    const char *split; // --split directory
+    const char *emit_index;
+    ArgVec link_indexes; // FILE=URL_PREFIX
+    ArgVec include_dirs;
+    ArgVec exclude_paths;
+    bool only_main_file;
+    bool fast;
+} Job;
+
+typedef struct {
+    Job *data;
+    size_t n, cap;
+} JobVec;
+
+static void job_free(Job *job) {
+    free(job->inputs.data);
+    free(job->args.data);
+    free(job->ignore.data);
+    free(job->link_indexes.data);
+    free(job->include_dirs.data);
+    free(job->exclude_paths.data);
+}
+
+static void manifest_error(const char *path, int line, const char *msg) {
+    fprintf(stderr, "error: %s:%d: %s\n", path, line, msg);
+    exit(1);
+}
+
+static bool manifest_bool(const char *path, int line, const char *key, const char *value) {
+    if (strcmp(value, "yes") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0) return true;
+    if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0 || strcmp(value, "0") == 0) return false;
+    fprintf(stderr, "error: %s:%d: %s expects yes or no\n", path, line, key);
+    exit(1);
+}
+
+/* --manifest FILE, in an INI-like format:
+ *
+ *     # comment
+ *     [name]
+ *     inputs = include/foo.h include/bar.h
+ *     args = -Iinclude -DFOO_API=
+ *     ignore = foo_internal_*
+ *     output = docs/foo.md
+ *     link-index = docs/base.idx=../base/API.md
+ *     include-dir = include
+ *
+ * List values are split on whitespace and repeated keys append; pch, compdb,
+ * split (instead of output), index (as --emit-index), fast and
+ * only-main-file (yes/no) take one value. Every job starts from the command
+ * line's --ignore, --link-index, --include-dir, --exclude-path,
+ * --only-main-file, --pch, --compdb, --fast and clang args. `text` is kept for
+ * the life of the jobs since they point into it. */
+static void manifest_parse(const char *path, char *text, const Job *defaults, JobVec *jobs) {
+    Job *job = NULL;
+    int lineno = 0;
+    for (char *line = text; line;) {
+        char *eol = strchr(line, '\n');
+        if (eol) *eol = '\0';
+        char *next = eol ? eol + 1 : NULL;
+        ++lineno;
+        trim_trailing_space(line);
+        while (*line == ' ' || *line == '\t') ++line;
+        if (!*line || *line == '#' || *line == ';') { line = next; continue; }
+
+        if (*line == '[') {
+            char *close = strchr(line, ']');
+            if (!close || close[1]) manifest_error(path, lineno, "expected [job name]");
+            *close = '\0';
+            if (!line[1]) manifest_error(path, lineno, "job name is empty");
+            if (jobs->n == jobs->cap) {
+                jobs->cap = jobs->cap ? jobs->cap * 2 : 16;
+                jobs->data = (Job*)realloc(jobs->data, jobs->cap * sizeof(Job));
+                if (!jobs->data) die("out of memory");
+            }
+            job = &jobs->data[jobs->n++];
+            memset(job, 0, sizeof(*job));
+            job->name = line + 1;
+            for (int i = 0; i < defaults->args.n; ++i) argvec_push(&job->args, defaults->args.data[i]);
+            for (int i = 0; i < defaults->ignore.n; ++i) argvec_push(&job->ignore, defaults->ignore.data[i]);
+            for (int i = 0; i < defaults->link_indexes.n; ++i) argvec_push(&job->link_indexes, defaults->link_indexes.data[i]);
+            for (int i = 0; i < defaults->include_dirs.n; ++i) argvec_push(&job->include_dirs, defaults->include_dirs.data[i]);
+            for (int i = 0; i < defaults->exclude_paths.n; ++i) argvec_push(&job->exclude_paths, defaults->exclude_paths.data[i]);
+            job->only_main_file = defaults->only_main_file;
+            job->pch = defaults->pch;
+            job->compdb = defaults->compdb;
+            job->fast = defaults->fast;
+            line = next;
+            continue;
+        }
+
+        char *eq = strchr(line, '=');
+        if (!eq) manifest_error(path, lineno, "expected key = value");
+        if (!job) manifest_error(path, lineno, "key outside of a [job] section");
+        char *key_end = eq;
+        while (key_end > line && (key_end[-1] == ' ' || key_end[-1] == '\t')) --key_end;
+        *key_end = '\0';
+        ArgVec values = {0};
+        for (char *v = eq + 1;;) {
+            while (*v == ' ' || *v == '\t') ++v;
+            if (!*v) break;
+            argvec_push(&values, v);
+            while (*v && *v != ' ' && *v != '\t') ++v;
+            if (*v) *v++ = '\0';
+        }
+
+        ArgVec *list = strcmp(line, "inputs") == 0 ? &job->inputs
+                     : strcmp(line, "args") == 0 ? &job->args
+                     : strcmp(line, "ignore") == 0 ? &job->ignore
+                     : strcmp(line, "link-index") == 0 ? &job->link_indexes
+                     : strcmp(line, "include-dir") == 0 ? &job->include_dirs
+                     : strcmp(line, "exclude-path") == 0 ? &job->exclude_paths : NULL;
+        if (list) {
+            for (int i = 0; i < values.n; ++i) argvec_push(list, values.data[i]);
+        } else {
+            if (values.n != 1) manifest_error(path, lineno, "expected exactly one value");
+            const char *value = values.data[0];
+            if (strcmp(line, "output") == 0) job->output = value;
+            else if (strcmp(line, "split") == 0) job->split = value;
+            else if (strcmp(line, "index") == 0) job->emit_index = value;
+            else if (strcmp(line, "pch") == 0) job->pch = value;
+            else if (strcmp(line, "compdb") == 0) job->compdb = value;
+            else if (strcmp(line, "fast") == 0) job->fast = manifest_bool(path, lineno, line, value);
+            else if (strcmp(line, "only-main-file") == 0) job->only_main_file = manifest_bool(path, lineno, line, value);
+            else {
+                manifest_error(path, lineno, "unknown key");
+            }
+        }
+        free(values.data);
+        line = next;
+    }
+
+    if (jobs->n == 0) manifest_error(path, lineno, "no [job] sections");
+    for (size_t i = 0; i < jobs->n; ++i) {
+        const Job *j = &jobs->data[i];
+        if (!j->output == !j->split) {
+            fprintf(stderr, "error: %s: job [%s] needs exactly one of output and split\n", path, j->name);
+            exit(1);
+        }
+        if (j->inputs.n == 0 && !j->compdb) {
+            fprintf(stderr, "error: %s: job [%s] has no inputs\n", path, j->name);
+            exit(1);
+        }
+        const char *dest = j->output ? j->output : j->split;
+        for (size_t k = 0; k < i; ++k) {
+            const char *other = jobs->data[k].output ? jobs->data[k].output : jobs->data[k].split;
+            if (strcmp(other, dest) == 0) {
+                fprintf(stderr, "error: %s: jobs [%s] and [%s] both write %s\n", path, jobs->data[k].name, j->name, dest);
+                exit(1);
+            }
+        }
+    }
+}
+
+/* Fail before any work if `path` could not be created because its directory
+ * is missing, rather than after the other outputs were written. */
+static void require_parent_dir(const char *path, const char *option) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return;
+    char dir[4096];
+    size_t len = slash == path ? 1 : (size_t)(slash - path);
+    if (len >= sizeof(dir)) return;
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "error: %s %s: directory %s does not exist\n", option, path, dir);
+        exit(1);
+    }
+}
+
+/* Run one job from parsing to output and reset the run-wide tables for the
+ * next. What outlives it: the pooled indexes, compiled prefix headers, the
+ * header digests and the --cache-dir. */
+static void run_job(const Job *job, int jobs, PchCache *pchs) {
+    uint64_t job_span = trace_begin();
+    g_fast = job->fast;
+    g_emit_index = job->emit_index;
+    if (g_emit_index) require_parent_dir(g_emit_index, "--emit-index");
+    for (int i = 0; i < job->link_indexes.n; ++i) link_index_load(job->link_indexes.data[i]);
+    for (int i = 0; i < job->ignore.n; ++i) set_add(&g_ignore_patterns, job->ignore.data[i]);
+    g_only_main_file = job->only_main_file;
+    for (int i = 0; i < job->include_dirs.n; ++i) scope_add_pattern(&g_include_dirs, job->include_dirs.data[i], true);
+    for (int i = 0; i < job->exclude_paths.n; ++i) scope_add_pattern(&g_exclude_paths, job->exclude_paths.data[i], false);
+    g_scoped = g_only_main_file || g_include_cwd || g_include_dirs.n || g_exclude_paths.n;
+
+    int nfiles = job->inputs.n;
+    CXCompilationDatabase compdb = NULL;
+    CXCompileCommands all_commands = NULL;
+    if (job->compdb) {
+        CXCompilationDatabase_Error err = CXCompilationDatabase_NoError;
+        compdb = clang_CompilationDatabase_fromDirectory(job->compdb, &err);
+        if (err != CXCompilationDatabase_NoError || !compdb) die("cannot load compile_commands.json from --compdb directory");
+        // Without explicit inputs, document everything the database builds.
+        if (nfiles <= 0) {
+            all_commands = clang_CompilationDatabase_getAllCompileCommands(compdb);
+            nfiles = (int)clang_CompileCommands_getSize(all_commands);
+        }
+    }
+    if (nfiles <= 0) die("no input files");
+    int cargc = job->args.n;
+    const char **cargv = cargc > 0 ? job->args.data : NULL;
+
+    FileResult *results = (FileResult*)calloc((size_t)nfiles, sizeof(FileResult));
+    if (!results) die("out of memory");
+    for (int i = 0; i < nfiles; ++i) {
+        results[i].path = all_commands ? "" : job->inputs.data[i];
+        results[i].index = i;
+    }
+    globset_compile(&g_ignore, &g_ignore_patterns);
+    globset_compile(&g_include_globs, &g_include_dirs);
+    globset_compile(&g_exclude_globs, &g_exclude_paths);
+    Hasher salt = {{0, 0}};
+    hasher_add_str(&salt, CACHE_MAGIC);
+    for (int i = 0; i < cargc; ++i) hasher_add_str(&salt, cargv[i]);
+    hasher_add_str(&salt, "--ignore");
+    for (size_t i = 0; i < g_ignore_patterns.n; ++i) hasher_add_str(&salt, g_ignore_patterns.data[i]);
+    hasher_add_str(&salt, g_only_main_file ? "--only-main-file" : "");
+    hasher_add_str(&salt, g_include_cwd ? "--include-dir ." : "--include-dir");
+    for (size_t i = 0; i < g_include_dirs.n; ++i) hasher_add_str(&salt, g_include_dirs.data[i]);
+    hasher_add_str(&salt, "--exclude-path");
+    for (size_t i = 0; i < g_exclude_paths.n; ++i) hasher_add_str(&salt, g_exclude_paths.data[i]);
+    hasher_add_str(&salt, g_fast ? "fast" : "full");
+    hasher_add_str(&salt, g_emit_index ? "index" : "");
+
+    const char **parse_argv = cargv;
+    int parse_argc = cargc;
+    if (job->pch) {
+        const Pch *pch = pch_get(pchs, job->pch, cargc, cargv);
+        hasher_add_str(&salt, "--pch");
+        hasher_add(&salt, &pch->inclusions, sizeof(pch->inclusions));
+        g_pch_in_use = true;
+        parse_argv = pch->argv;
+        parse_argc = pch->argc;
+    }
+    if (compdb) {
+        for (int i = 0; i < nfiles; ++i) {
+            if (all_commands) {
+                compdb_apply(&results[i], clang_CompileCommands_getCommand(all_commands, (unsigned)i),
+                             parse_argc, parse_argv);
+                continue;
+            }
+            // The database is keyed by absolute path.
+            char abs[4096];
+            if (results[i].path[0] == '/') snprintf(abs, sizeof(abs), "%s", results[i].path);
+            else if (getcwd(abs, sizeof(abs))) snprintf(abs + strlen(abs), sizeof(abs) - strlen(abs), "/%s", results[i].path);
+            else continue;
+            CXCompileCommands cmds = clang_CompilationDatabase_getCompileCommands(compdb, abs);
+            if (cmds && clang_CompileCommands_getSize(cmds) > 0) {
+                compdb_apply(&results[i], clang_CompileCommands_getCommand(cmds, 0), parse_argc, parse_argv);
+            }
+            if (cmds) clang_CompileCommands_dispose(cmds);
+        }
+        if (all_commands) clang_CompileCommands_dispose(all_commands);
+        clang_CompilationDatabase_dispose(compdb);
+    }
+    if (g_cache_dir) {
+        if (mkdir(g_cache_dir, 0777) != 0 && errno != EEXIST) die("cannot create --cache-dir directory");
+        g_cache_salt = salt.d;
+    }
+    usr_registry_init();
+    int *order = (int*)malloc((size_t)nfiles * sizeof(int));
+    if (!order) die("out of memory");
+    if (jobs > 1) schedule_inputs(results, nfiles, order);
+    else for (int i = 0; i < nfiles; ++i) order[i] = i;
+    WorkQueue queue = { results, nfiles, parse_argc, parse_argv, job->pch != NULL, order, 0 };
+    run_workers(&queue, jobs);
+    free(order);
+    if (g_cache_dir) timings_save(results, nfiles);
+    Stats summary_stats = {0};
+    g_section_hashes = job->output || job->split;
+    if (job->split) {
+        write_split(results, nfiles, job->split, jobs, g_stats ? &summary_stats : NULL);
+    } else {
+        OutputFile output;
+        FILE *out = job->output ? output_open(&output, job->output) : stdout;
+        write_document(results, nfiles, out, g_stats ? &summary_stats : NULL);
+        if (job->output) output_commit(&output);
+    }
+    if (g_emit_index) {
+        uint64_t span = trace_begin();
+        emit_index(g_emit_index, results);
+        trace_end("index", span, g_emit_index, "symbols", g_macros.n + g_types.n + g_functions.n);
+    }
+    if (g_stats) {
+        fflush(stdout);
+        if (job->name) fprintf(stderr, "\njob %s -> %s", job->name, job->output ? job->output : job->split);
+        print_stats(results, nfiles, &summary_stats);
+    }
+    trace_end("job", job_span, job->name ? job->name : "(command line)", "inputs", (size_t)nfiles);
+#ifdef __linux__
+    if (g_watch) {
+        // The loop runs until interrupted; the initial build's trace is done.
+        if (g_trace.path) trace_write();
+        watch_loop(&queue, job->output);
+    }
+#endif
+    for (int i = 0; i < nfiles; ++i) {
+        for (int k = 0; k < results[i].nargs; ++k) free(results[i].args[k]);
+        free(results[i].args);
+        free(results[i].compdb_path);
+        if (results[i].tu) clang_disposeTranslationUnit(results[i].tu);
+        free_file_result(&results[i]);
+        set_free(&results[i].deps);
+        sb_free(&results[i].linked);
+    }
+    free(results);
+    index_release_kept();
+#ifdef DOC_GEN_ALLOC_COUNT
+    size_t nsyms = g_macros.n + g_types.n + g_functions.n;
+    size_t nallocs = atomic_load(&g_alloc_count);
+    fprintf(stderr, "allocations: %zu for %zu symbols (%.1f per symbol)\n",
+            nallocs, nsyms, nsyms ? (double)nallocs / (double)nsyms : 0.0);
+#endif
+    entryvec_free(&g_macros);
+    entryvec_free(&g_types);
+    entryvec_free(&g_functions);
+    symindex_free(&g_symbol_index);
+    set_free(&g_ignore_patterns);
+    globset_free(&g_ignore);
+    set_free(&g_include_dirs);
+    set_free(&g_exclude_paths);
+    g_include_cwd = false;
+    globset_free(&g_include_globs);
+    globset_free(&g_exclude_globs);
+    usr_registry_free();
+    shards_free(nfiles);
+    link_indexes_free();
+    g_pch_in_use = false;
 }
 
 int main(int argc, const char **argv) {
@@ -1331,8 +4582,8 @@ int main(int argc, const char **argv) {
             print_help(argv[0]);
             return 0;
         }
-        if (strcmp(argv[i], "--ignore") == 0) {
-            ++i; // skip pattern placeholder if present
+        if (option_takes_value(argv[i])) {
+            ++i; // skip option argument if present
         }
     }
 
@@ -1342,10 +4593,105 @@ int main(int argc, const char **argv) {
         return 2;
     }
     int argi = 1;
+    int jobs = 1;
+    const char *manifest_path = NULL;
+    Job cli = {0};
     while (argi < argc && strcmp(argv[argi], "--") != 0) {
         if (strcmp(argv[argi], "--ignore") == 0) {
             if (argi + 1 >= argc) die("missing pattern after --ignore");
-            set_add(&g_ignore_patterns, argv[argi + 1]);
+            argvec_push(&cli.ignore, argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "-j") == 0 || strcmp(argv[argi], "--jobs") == 0) {
+            if (argi + 1 >= argc) die("missing count after --jobs");
+            jobs = parse_jobs(argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--cache-dir") == 0) {
+            if (argi + 1 >= argc) die("missing directory after --cache-dir");
+            g_cache_dir = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--pch") == 0) {
+            if (argi + 1 >= argc) die("missing header after --pch");
+            cli.pch = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--fast") == 0) {
+            cli.fast = true;
+            argi += 1;
+            continue;
+        }
+        if (strcmp(argv[argi], "--only-main-file") == 0) {
+            cli.only_main_file = true;
+            argi += 1;
+            continue;
+        }
+        if (strcmp(argv[argi], "--include-dir") == 0) {
+            if (argi + 1 >= argc) die("missing pattern after --include-dir");
+            argvec_push(&cli.include_dirs, argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--exclude-path") == 0) {
+            if (argi + 1 >= argc) die("missing pattern after --exclude-path");
+            argvec_push(&cli.exclude_paths, argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--stats") == 0) {
+            g_stats = true;
+            argi += 1;
+            continue;
+        }
+        if (strcmp(argv[argi], "-o") == 0) {
+            if (argi + 1 >= argc) die("missing file after -o");
+            cli.output = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--watch") == 0) {
+            g_watch = true;
+            argi += 1;
+            continue;
+        }
+        if (strcmp(argv[argi], "--compdb") == 0) {
+            if (argi + 1 >= argc) die("missing directory after --compdb");
+            cli.compdb = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--trace-out") == 0) {
+            if (argi + 1 >= argc) die("missing file after --trace-out");
+            g_trace.path = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--split") == 0) {
+            if (argi + 1 >= argc) die("missing directory after --split");
+            cli.split = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--emit-index") == 0) {
+            if (argi + 1 >= argc) die("missing path after --emit-index");
+            cli.emit_index = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--link-index") == 0) {
+            if (argi + 1 >= argc) die("missing FILE=URL_PREFIX after --link-index");
+            argvec_push(&cli.link_indexes, argv[argi + 1]);
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--manifest") == 0) {
+            if (argi + 1 >= argc) die("missing file after --manifest");
+            manifest_path = argv[argi + 1];
             argi += 2;
             continue;
         }
@@ -1356,46 +4702,64 @@ int main(int argc, const char **argv) {
     for (int i = argi; i < argc; ++i) if (strcmp(argv[i], "--") == 0) { split = i; break; }
 
     for (int i = argi; i < split; ++i) {
-        if (strcmp(argv[i], "--ignore") == 0) die("--ignore must appear before input files");
+        if (option_takes_value(argv[i]) || option_is_flag(argv[i])) {
+            fprintf(stderr, "error: %s must appear before input files\n", argv[i]);
+            return 1;
+        }
     }
+    for (int i = argi; i < split; ++i) argvec_push(&cli.inputs, argv[i]);
+    for (int i = split + 1; i < argc; ++i) argvec_push(&cli.args, argv[i]);
 
-    int nfiles = split - argi;
-    if (nfiles <= 0) die("no input files");
-    int cargc = (split < argc) ? (argc - split - 1) : 0;
-    const char **cargv = (cargc > 0) ? (argv + split + 1) : NULL;
-
-    FILE *body = tmpfile();
-    if (!body) die("failed to allocate temporary buffer");
-    g_out = body;
-    printf("# API Documentation\n\n");
-    CXIndex idx = clang_createIndex(/*excludeDeclsFromPCH=*/0, /*displayDiagnostics=*/0);
-    for (int i = 0; i < nfiles; ++i) {
-        process_file(idx, argv[argi + i], cargc, cargv);
-    }
-    clang_disposeIndex(idx);
-    print_summary_section("Macros", &g_macros, false);
-    print_summary_section("Types", &g_types, true);
-    print_summary_section("Functions", &g_functions, false);
-    rewind(body);
-    StrBuf output = {0};
-    char buf[4096];
-    size_t read_bytes;
-    while ((read_bytes = fread(buf, 1, sizeof(buf), body)) > 0) {
-        sb_append_n(&output, buf, read_bytes);
-    }
-    fclose(body);
-    char *linked = apply_docstring_links(output.buf ? output.buf : "");
-    if (linked) {
-        fwrite(linked, 1, strlen(linked), stdout);
-        free(linked);
-    } else if (output.buf && output.len) {
-        fwrite(output.buf, 1, output.len, stdout);
-    }
-    sb_free(&output);
-    entryvec_free(&g_macros);
-    entryvec_free(&g_types);
-    entryvec_free(&g_functions);
-    filedocs_free(&g_file_docs);
-    set_free(&g_ignore_patterns);
+    if (g_watch) {
+#ifndef __linux__
+        die("--watch relies on inotify and is only available on Linux");
+#endif
+        if (!cli.output) die("--watch needs -o FILE");
+        if (g_cache_dir) die("--watch cannot be combined with --cache-dir");
+        if (manifest_path) die("--watch cannot be combined with --manifest");
+        if (cli.split) die("--watch cannot be combined with --split");
+    }
+    if (cli.split && cli.output) die("--split and -o cannot be combined");
+
+    JobVec manifest = {0};
+    char *manifest_text = NULL;
+    if (manifest_path) {
+        if (cli.inputs.n > 0) die("--manifest takes its inputs from the manifest, not the command line");
+        if (cli.output || cli.split || cli.emit_index) {
+            die("--manifest takes output paths from the manifest, not -o, --split or --emit-index");
+        }
+        size_t len = 0;
+        manifest_text = read_file(manifest_path, &len);
+        if (!manifest_text) die("cannot read --manifest file");
+        manifest_parse(manifest_path, manifest_text, &cli, &manifest);
+    }
+
+    read_cwd();
+    // libclang runs each parse on a crash-recovery thread of its own, which
+    // CLOCK_THREAD_CPUTIME_ID does not see, so the parse column would show
+    // almost no CPU time. Have it parse on the calling thread instead.
+    if (g_stats) setenv("LIBCLANG_NOTHREADS", "1", 1);
+    if (g_trace.path) {
+        g_trace.t0 = clock_ns(CLOCK_MONOTONIC);
+        trace_register_thread("main");
+    }
+    PchCache pchs = {0};
+    if (manifest_path) {
+        for (size_t i = 0; i < manifest.n; ++i) {
+            if (manifest.data[i].emit_index) require_parent_dir(manifest.data[i].emit_index, "index");
+        }
+        for (size_t i = 0; i < manifest.n; ++i) run_job(&manifest.data[i], jobs, &pchs);
+    } else {
+        run_job(&cli, jobs, &pchs);
+    }
+    if (g_trace.path && !g_watch) trace_write();
+    pch_cache_free(&pchs);
+    for (size_t i = 0; i < manifest.n; ++i) job_free(&manifest.data[i]);
+    free(manifest.data);
+    free(manifest_text);
+    job_free(&cli);
+    index_pool_free();
+    header_digests_free();
+    arena_free(&t_arena);
     return 0;
 }